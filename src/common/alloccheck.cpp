@@ -0,0 +1,31 @@
+#include "alloccheck.h"
+
+#ifndef NDEBUG
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+namespace VCL {
+
+namespace {
+thread_local int alloc_free_depth = 0;
+std::atomic<long long> alloc_count(0);
+}
+
+AllocFree::AllocFree() { alloc_free_depth++; }
+
+AllocFree::~AllocFree() { alloc_free_depth--; }
+
+void CountAllocation() {
+  if (alloc_free_depth) alloc_count++;
+}
+
+void CheckAllocFree(const char *pass) {
+  const long long count = alloc_count.exchange(0);
+  if (!count) return;
+  std::fprintf(stderr, "%lld heap allocations during %s\n", count, pass);
+  std::abort();
+}
+
+};  // namespace VCL
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+
+namespace VCL {
+
+// Render passes do not touch the heap: the kernels use fixed capacity
+// storage and the buffers they write are sized between passes. Debug builds
+// check it: operator new counts the allocations of threads inside an
+// AllocFree scope, and CheckAllocFree aborts if there were any since the
+// last check. Release builds (NDEBUG) compile both to nothing.
+//
+// The library does not replace operator new, programs embedding it keep
+// their allocator. The app links src/renderer/allocnew.cpp, which does and
+// calls CountAllocation; without it the checks pass trivially.
+#ifdef NDEBUG
+struct AllocFree
+{
+  AllocFree() { }
+};
+
+inline void CheckAllocFree(const char *) { }
+#else
+struct AllocFree
+{
+  AllocFree();
+  ~AllocFree();
+  AllocFree(const AllocFree &) = delete;
+  AllocFree &operator=(const AllocFree &) = delete;
+};
+
+// `pass` names the pass in the message
+void CheckAllocFree(const char *pass);
+
+// counts an allocation if this thread is inside an AllocFree scope
+void CountAllocation();
+#endif
+
+};
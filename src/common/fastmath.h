@@ -0,0 +1,124 @@
+#pragma once
+
+#include "mathtype.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+namespace VCL {
+
+// Polynomial stand-ins for the libm calls of the shading kernels, for
+// GlobIllum::FAST_MATH: straight-line code without tables or errno, which
+// the compiler can inline and schedule with the code around it. Largest
+// errors against double precision libm, measured over a dense sweep of the
+// stated ranges; tests/fastmath_test.cpp checks them:
+//
+//   FastExp2(x)      |x| <= 126               relative 1.1e-7
+//   FastLog2(x)      normal x > 0             absolute 1.2e-7 + 6e-8 |log2 x|
+//   FastPow(x, y)    x > 0, |y log2 x| < 126  relative 4.7e-7 + 1e-7 |y| + 6e-8 |y log2 x|
+//   FastSinCos(x)    |x| <= 1e4               absolute 9.4e-8
+//   FastRsqrt(x)     normal x > 0             relative 2.6e-7
+//
+// For the Phong exponent 30 of the scenes that is a few 1e-6, far below what 8 bit
+// output shows. Out of range: FastExp2 clamps to 2^+-126, FastPow hands
+// x <= 0 to std::pow, FastLog2 of x <= 0 is meaningless.
+
+// round to nearest for |x| < 2^22, without the libm call nearbyint is on plain SSE2
+inline real RoundNearest(real x) {
+  constexpr real kMagic = real(12582912); // 1.5 * 2^23
+  return (x + kMagic) - kMagic;
+}
+
+inline real FastExp2(real x) {
+  x = std::min(std::max(x, real(-126)), real(126));
+  // 2^x = 2^i 2^f, f in [-0.5, 0.5]
+  const real i = RoundNearest(x);
+  const real f = x - i;
+  const real p = real(1) + f * (real(6.931472028550421e-1) + f * (real(2.402264791363012e-1) +
+                 f * (real(5.550332471162809e-2) + f * (real(9.618437357674640e-3) +
+                 f * (real(1.339887440266574e-3) + f * real(1.535336188319500e-4))))));
+  const uint32_t bits = uint32_t(int32_t(i) + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+inline real FastLog2(real x) {
+  // x = 2^e m, m in [sqrt(1/2), sqrt(2))
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  int32_t e = int32_t(bits >> 23) - 127;
+  bits = (bits & 0x007FFFFFu) | 0x3F800000u;
+  float m;
+  std::memcpy(&m, &bits, sizeof(m));
+  if (m > real(1.41421356)) {
+    m *= real(0.5);
+    e++;
+  }
+  // log2 m = 2 / ln 2 atanh t, |t| < 0.172
+  const real t = (m - 1) / (m + 1);
+  const real t2 = t * t;
+  const real s = t * (real(2.885390082) + t2 * (real(0.9617966939) + t2 * (real(0.5770780164) + t2 * real(0.4121985831))));
+  return real(e) + s;
+}
+
+inline real FastPow(real x, real y) {
+  if (!(x > 0)) return std::pow(x, y); // signs, zeros and NaNs as libm has them
+  return FastExp2(y * FastLog2(x));
+}
+
+inline void FastSinCos(real x, real &s, real &c) {
+  // x = j pi / 2 + r, r in [-pi / 4, pi / 4]; pi / 2 in three parts
+  const real j = RoundNearest(x * real(0.636619772));
+  const real r = ((x - j * real(1.5703125)) - j * real(4.837512969970703125e-4)) - j * real(7.549789948768648e-8);
+  const real z = r * r;
+  const real sr = r + r * z * (real(-1.6666654611e-1) + z * (real(8.3321608736e-3) + z * real(-1.9515295891e-4)));
+  const real cr = 1 - real(0.5) * z + z * z * (real(4.166664568298827e-2) + z * (real(-1.388731625493765e-3) +
+                  z * real(2.443315711809948e-5)));
+  const int q = int(int64_t(j) & 3);
+  s = (q & 1) ? cr : sr;
+  c = (q & 1) ? sr : cr;
+  if (q == 1 || q == 2) c = -c;
+  if (q & 2) s = -s;
+}
+
+inline real FastRsqrt(real x) {
+#if defined(__SSE__) || defined(_M_X64)
+  // 12 bit estimate and one Newton step
+  const real y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+  return y * (real(1.5) - real(0.5) * x * y * y);
+#else
+  return 1 / std::sqrt(x);
+#endif
+}
+
+// the kernels pick the precise or the fast version at compile time
+namespace Math {
+template <bool Fast>
+inline real Pow(real x, real y) {
+  if constexpr (Fast) return FastPow(x, y);
+  else return std::pow(x, y);
+}
+
+template <bool Fast>
+inline void SinCos(real x, real &s, real &c) {
+  if constexpr (Fast) FastSinCos(x, s, c);
+  else {
+    s = std::sin(x);
+    c = std::cos(x);
+  }
+}
+
+template <bool Fast>
+inline Vec3 Normalized(const Vec3 &v) {
+  if constexpr (Fast) return v * FastRsqrt(v.squaredNorm());
+  else return v.normalized();
+}
+}  // namespace Math
+
+};
@@ -1,6 +1,9 @@
 #include "helperfunc.h"
 
+#include "alloccheck.h"
+
 #include <random>
+#include <omp.h>
 #include "ctime"
 #include "cstdlib"
 #define N  999 //精度为小数点后面3位
@@ -31,4 +34,69 @@ real rand_01(){
   return random;
 }
 
+static uint32_t ExpandBits(uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+uint32_t MortonCode3(uint32_t x, uint32_t y, uint32_t z) {
+  return (ExpandBits(x) << 2) | (ExpandBits(y) << 1) | ExpandBits(z);
+}
+
+static constexpr int RADIX_BITS = 8;
+static constexpr int BUCKETS = 1 << RADIX_BITS;
+
+void RadixScratch::Reserve(int n) {
+  keys_.reserve(n);
+  values_.reserve(n);
+  hist_.reserve(size_t(omp_get_max_threads()) * BUCKETS);
+}
+
+void RadixSortPairs(std::vector<uint64_t> &keys, std::vector<int> &values, int key_bits, RadixScratch &scratch) {
+  const int n = int(keys.size());
+  std::vector<uint64_t> &tmp_keys = scratch.keys_;
+  std::vector<int> &tmp_values = scratch.values_;
+  tmp_keys.resize(n);
+  tmp_values.resize(n);
+  const int num_threads = omp_get_max_threads();
+  std::vector<int> &hist = scratch.hist_;
+  hist.resize(size_t(num_threads) * BUCKETS);
+
+  for (int shift = 0; shift < key_bits; shift += RADIX_BITS) {
+    std::fill(hist.begin(), hist.end(), 0);
+    #pragma omp parallel num_threads(num_threads)
+    {
+      AllocFree alloc_free;
+      const int nt = omp_get_num_threads();
+      const int t = omp_get_thread_num();
+      const int begin = int(int64_t(n) * t / nt);
+      const int end = int(int64_t(n) * (t + 1) / nt);
+      int *h = &hist[size_t(t) * BUCKETS];
+      for (int i = begin; i < end; i++) h[(keys[i] >> shift) & (BUCKETS - 1)]++;
+      #pragma omp barrier
+      #pragma omp single
+      {
+        // bucket-major prefix sum so every thread scatters to its own range
+        int sum = 0;
+        for (int b = 0; b < BUCKETS; b++)
+          for (int s = 0; s < nt; s++) {
+            const int c = hist[size_t(s) * BUCKETS + b];
+            hist[size_t(s) * BUCKETS + b] = sum;
+            sum += c;
+          }
+      }
+      for (int i = begin; i < end; i++) {
+        const int dst = h[(keys[i] >> shift) & (BUCKETS - 1)]++;
+        tmp_keys[dst] = keys[i];
+        tmp_values[dst] = values[i];
+      }
+    }
+    keys.swap(tmp_keys);
+    values.swap(tmp_values);
+  }
+}
+
 };  // namespace VCL
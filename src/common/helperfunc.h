@@ -2,6 +2,9 @@
 
 #include "mathtype.h"
 
+#include <cstdint>
+#include <vector>
+
 namespace VCL {
 
 unsigned char FloatToUChar(float x);
@@ -11,4 +14,14 @@ void ConvertColor(Vec4f input, unsigned char output[4]);
 real rand01();
 real rand_01();
 
+uint32_t MortonCode3(uint32_t x, uint32_t y, uint32_t z); // 10 bits per axis
+// LSD radix sort of (key, value) pairs on the lowest key_bits bits, parallel per pass;
+// the scratch buffers only grow, a caller that keeps them sorts without allocating
+struct RadixScratch {
+  std::vector<uint64_t> keys_;
+  std::vector<int> values_, hist_;
+  void Reserve(int n);  // for sorts of up to n pairs
+};
+void RadixSortPairs(std::vector<uint64_t> &keys, std::vector<int> &values, int key_bits, RadixScratch &scratch);
+
 };
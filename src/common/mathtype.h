@@ -58,6 +58,8 @@ using Quat = Eigen::Quaternion<real>;
 using Quatf = Eigen::Quaternionf;
 using Quatd = Eigen::Quaterniond;
 
+using Affine3 = Eigen::Transform<real, 3, Eigen::Affine>;
+
 using Vec6f = Eigen::Matrix<float, 6, 1>;
 using Vec6d = Eigen::Matrix<double, 6, 1>;
 using Vec6i = Eigen::Matrix<int, 6, 1>;
@@ -82,14 +84,6 @@ using Mat = Eigen::Matrix<real, d, d>;
 
 constexpr float PI_ = 3.14159265f; 
 constexpr real EPS_ = 1e-6;
-constexpr real XMIN_ = -2;
-constexpr real XMAX_ = 2;
-constexpr real YMIN_ = 0;
-constexpr real YMAX_ = 3;
-constexpr real ZMIN_ = -4;
-constexpr real ZMAX_ = 0;
-inline Vec3 POSMIN_ = Vec3(XMIN_, YMIN_, ZMIN_);
-inline Vec3 POSMAX_ = Vec3(XMAX_, YMAX_, ZMAX_);
 
 struct Ray {
 	Vec3 ori_;
@@ -0,0 +1,22 @@
+#include "animation.h"
+
+#include <algorithm>
+
+namespace VCL {
+
+Affine3 Track::Evaluate(real time) const
+{
+  const auto next = std::upper_bound(keys_.begin(), keys_.end(), time,
+                                     [](real t, const Keyframe &key) { return t < key.time_; });
+  const Keyframe &a = next == keys_.begin() ? *next : *(next - 1);
+  const Keyframe &b = next == keys_.end() ? *(next - 1) : *next;
+  const real s = b.time_ > a.time_ ? std::clamp((time - a.time_) / (b.time_ - a.time_), real(0), real(1)) : 0;
+
+  Affine3 xf = Affine3::Identity();
+  xf.translate(a.translation_ + s * (b.translation_ - a.translation_));
+  xf.rotate(a.rotation_.slerp(s, b.rotation_));
+  xf.scale(a.scale_ + s * (b.scale_ - a.scale_));
+  return xf;
+}
+
+}
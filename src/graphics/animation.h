@@ -0,0 +1,33 @@
+#pragma once
+
+#include "graphics/instance.h"
+
+#include <vector>
+
+namespace VCL {
+
+struct Keyframe
+{
+  real time_; // seconds
+  Vec3 translation_ = Vec3::Zero();
+  Quat rotation_ = Quat::Identity();
+  real scale_ = 1; // uniform, so emitter spheres stay spheres
+};
+
+// keyframed transform of one instance, interpolated linearly (slerp for the
+// rotation) and held constant outside the keyframe range
+class Track
+{
+public:
+
+  Instance *target_;
+  std::vector<Keyframe> keys_; // sorted by time, not empty
+
+public:
+
+  Track(Instance *target, std::vector<Keyframe> keys) : target_(target), keys_(std::move(keys)) { }
+
+  Affine3 Evaluate(real time) const;
+};
+
+}
@@ -0,0 +1,185 @@
+#include "bvh.h"
+
+namespace VCL {
+
+namespace {
+constexpr int kBins = 12;
+constexpr int kLeafSize = 4;
+constexpr int kMaxSahDepth = 32; // deeper nodes split at the median to bound the stack
+constexpr real kRebuildRatio = 1.5;
+}
+
+void BVH::Build(const std::vector<const Object *> &objs)
+{
+  prims_.clear();
+  unbounded_.clear();
+  for (const Object *obj : objs) {
+    if (obj->Bounds().Bounded()) prims_.push_back(obj);
+    else unbounded_.push_back(obj);
+  }
+  Rebuild();
+}
+
+void BVH::Adopt(Node *nodes, int num_nodes, std::vector<const Object *> prims, std::vector<const Object *> unbounded)
+{
+  storage_.clear();
+  nodes_ = nodes;
+  num_nodes_ = num_nodes;
+  prims_ = std::move(prims);
+  unbounded_ = std::move(unbounded);
+  boxes_.clear(); // only needed by Refit
+  build_cost_ = Cost();
+}
+
+void BVH::Clone(const BVH &other, std::vector<const Object *> prims, std::vector<const Object *> unbounded)
+{
+  storage_.assign(other.nodes_, other.nodes_ + other.num_nodes_);
+  nodes_ = storage_.data();
+  num_nodes_ = other.num_nodes_;
+  prims_ = std::move(prims);
+  unbounded_ = std::move(unbounded);
+  boxes_.clear(); // only needed by Refit
+  build_cost_ = other.build_cost_; // rebuilds when the original would have
+}
+
+void BVH::Rebuild()
+{
+  storage_.clear();
+  boxes_.resize(prims_.size());
+  for (size_t i = 0; i < prims_.size(); i++) boxes_[i] = prims_[i]->Bounds();
+  if (!prims_.empty()) {
+    storage_.reserve(2 * prims_.size());
+    BuildNode(0, int(prims_.size()), 0);
+  }
+  nodes_ = storage_.data();
+  num_nodes_ = int(storage_.size());
+  build_cost_ = Cost();
+}
+
+bool BVH::Refit()
+{
+  if (num_nodes_ == 0) return false;
+  boxes_.resize(prims_.size());
+  for (size_t i = 0; i < prims_.size(); i++) boxes_[i] = prims_[i]->Bounds();
+  // children always come after their parent
+  for (int i = num_nodes_ - 1; i >= 0; i--) {
+    Node &node = nodes_[i];
+    node.box_ = AABB();
+    if (node.count_ > 0) {
+      for (int k = node.first_; k < node.first_ + node.count_; k++) node.box_.Extend(boxes_[k]);
+    }
+    else {
+      node.box_.Extend(nodes_[i + 1].box_);
+      node.box_.Extend(nodes_[node.first_].box_);
+    }
+  }
+  if (Cost() <= kRebuildRatio * build_cost_) return false;
+  Rebuild();
+  return true;
+}
+
+real BVH::Cost() const
+{
+  if (num_nodes_ == 0) return 0;
+  real cost = 0;
+  for (int i = 0; i < num_nodes_; i++) cost += nodes_[i].box_.Area() * (nodes_[i].count_ > 0 ? nodes_[i].count_ : 1);
+  const real root = nodes_[0].box_.Area();
+  return root > 0 ? cost / root : 0;
+}
+
+int BVH::BuildNode(int first, int count, int depth)
+{
+  const int index = int(storage_.size());
+  storage_.push_back({AABB(), first, count});
+  AABB box, centers;
+  for (int i = first; i < first + count; i++) {
+    box.Extend(boxes_[i]);
+    centers.Extend(boxes_[i].Center());
+  }
+  storage_[index].box_ = box;
+  if (count <= kLeafSize) return index;
+
+  int axis;
+  (centers.max_ - centers.min_).maxCoeff(&axis);
+  const real lo = centers.min_[axis];
+  const real extent = centers.max_[axis] - lo;
+  if (extent <= 0) return index; // all centers coincide
+
+  // binned SAH split along the widest axis of the centers
+  int mid = -1;
+  if (depth < kMaxSahDepth) {
+    AABB bin_box[kBins];
+    int bin_count[kBins] = {};
+    auto bin_of = [&](const AABB &b) { return std::min(int((b.Center()[axis] - lo) / extent * kBins), kBins - 1); };
+    for (int i = first; i < first + count; i++) {
+      const int b = bin_of(boxes_[i]);
+      bin_box[b].Extend(boxes_[i]);
+      bin_count[b]++;
+    }
+    real right_area[kBins];
+    int right_count[kBins];
+    AABB acc;
+    int n = 0;
+    for (int b = kBins - 1; b > 0; b--) {
+      acc.Extend(bin_box[b]);
+      n += bin_count[b];
+      right_area[b] = acc.Area();
+      right_count[b] = n;
+    }
+    real best = count * box.Area(); // cost of keeping a leaf
+    int best_bin = -1;
+    acc = AABB();
+    n = 0;
+    for (int b = 1; b < kBins; b++) {
+      acc.Extend(bin_box[b - 1]);
+      n += bin_count[b - 1];
+      if (n == 0 || right_count[b] == 0) continue;
+      const real cost = n * acc.Area() + right_count[b] * right_area[b];
+      if (cost < best) {
+        best = cost;
+        best_bin = b;
+      }
+    }
+    if (best_bin < 0) return index;
+    mid = first;
+    for (int i = first; i < first + count; i++) {
+      if (bin_of(boxes_[i]) < best_bin) {
+        std::swap(boxes_[i], boxes_[mid]);
+        std::swap(prims_[i], prims_[mid]);
+        mid++;
+      }
+    }
+  }
+  else {
+    // median split, partitioning the boxes and primitives together
+    order_.resize(count);
+    for (int i = 0; i < count; i++) order_[i] = first + i;
+    mid = first + count / 2;
+    std::nth_element(order_.begin(), order_.begin() + count / 2, order_.end(),
+                     [&](int a, int b) { return boxes_[a].Center()[axis] < boxes_[b].Center()[axis]; });
+    // apply the permutation by following its cycles
+    for (int i = 0; i < count; i++) {
+      if (order_[i] < 0) continue;
+      int j = i;
+      const AABB box = boxes_[first + i];
+      const Object *prim = prims_[first + i];
+      while (order_[j] - first != i) {
+        const int k = order_[j] - first;
+        boxes_[first + j] = boxes_[first + k];
+        prims_[first + j] = prims_[first + k];
+        order_[j] = -1;
+        j = k;
+      }
+      boxes_[first + j] = box;
+      prims_[first + j] = prim;
+      order_[j] = -1;
+    }
+  }
+
+  storage_[index].count_ = 0;
+  BuildNode(first, mid - first, depth + 1);
+  storage_[index].first_ = BuildNode(mid, first + count - mid, depth + 1);
+  return index;
+}
+
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "graphics/object.h"
+
+#include <cmath>
+#include <vector>
+
+namespace VCL {
+
+// Bounding volume hierarchy over a list of objects, built with binned SAH.
+// Objects without finite bounds (planes) are kept in a separate list and
+// tested on every query.
+class BVH
+{
+public:
+
+  struct Node
+  {
+    AABB box_;
+    int first_; // leaf: first primitive; interior: right child (left child is the next node)
+    int count_; // primitives in a leaf, 0 for interior nodes
+  };
+
+  BVH() = default;
+  BVH(const BVH &) = delete; // nodes_ may point into storage_
+  BVH &operator=(const BVH &) = delete;
+
+  void Build(const std::vector<const Object *> &objs);
+
+  // takes prebuilt nodes as they are, without copying, e.g. from a mapped
+  // SceneCache file, which has to outlive the BVH or its next rebuild;
+  // `prims` are in leaf order
+  void Adopt(Node *nodes, int num_nodes, std::vector<const Object *> prims, std::vector<const Object *> unbounded);
+
+  // copies the nodes of `other` into own storage, for copies of the objects
+  // it was built over: `prims` and `unbounded` hold them in the order of
+  // other.Prims() and other.Unbounded()
+  void Clone(const BVH &other, std::vector<const Object *> prims, std::vector<const Object *> unbounded);
+
+  // recomputes the node bounds bottom-up after objects moved, keeping the
+  // topology; rebuilds from the same objects once the SAH cost has grown
+  // past kRebuildRatio times the cost right after the last build.
+  // Returns true if it rebuilt. Reuses all buffers.
+  bool Refit();
+
+  // SAH cost relative to the root area
+  real Cost() const;
+
+  AABB Bounds() const
+  {
+    if (!unbounded_.empty()) return AABB::Infinite();
+    return num_nodes_ == 0 ? AABB() : nodes_[0].box_;
+  }
+
+  const Node *Nodes() const { return nodes_; }
+  int NumNodes() const { return num_nodes_; }
+  const std::vector<const Object *> &Prims() const { return prims_; }
+  const std::vector<const Object *> &Unbounded() const { return unbounded_; }
+
+  // calls leaf(obj) for every object whose box the ray enters before
+  // `t_max`; leaf may shorten t_max to prune the rest of the traversal
+  template <class Leaf>
+  void Traverse(const Ray &ray, const real &t_max, Leaf &&leaf) const
+  {
+    for (const Object *obj : unbounded_) leaf(obj);
+    if (num_nodes_ == 0) return;
+
+    const Vec3 inv_dir = ray.dir_.cwiseInverse();
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const int index = stack[--top];
+      const Node &node = nodes_[index];
+      if (!Overlaps(node.box_, ray.ori_, inv_dir, t_max)) continue;
+      if (node.count_ > 0) {
+        for (int i = node.first_; i < node.first_ + node.count_; i++) leaf(prims_[i]);
+        continue;
+      }
+      stack[top++] = node.first_;
+      stack[top++] = index + 1;
+    }
+  }
+
+private:
+
+  static bool Overlaps(const AABB &box, const Vec3 &ori, const Vec3 &inv_dir, real t_max)
+  {
+    real t_near = 0;
+    real t_far = t_max;
+    for (int a = 0; a < 3; a++) {
+      // near and far plane by the sign of the direction: an origin on a face
+      // of a slab the ray runs along gives 0 * inf = NaN, which is then only
+      // ever the second operand of max and min, and they ignore it
+      const bool negative = std::signbit(inv_dir[a]);
+      const real t0 = ((negative ? box.max_[a] : box.min_[a]) - ori[a]) * inv_dir[a];
+      const real t1 = ((negative ? box.min_[a] : box.max_[a]) - ori[a]) * inv_dir[a];
+      t_near = std::max(t_near, t0);
+      t_far = std::min(t_far, t1);
+    }
+    return t_near <= t_far;
+  }
+
+  void Rebuild();
+  int BuildNode(int first, int count, int depth);
+
+private:
+
+  Node *nodes_ = nullptr; // storage_ or adopted
+  int num_nodes_ = 0;
+  std::vector<Node> storage_;
+  std::vector<const Object *> prims_; // bounded objects in leaf order
+  std::vector<const Object *> unbounded_;
+  std::vector<AABB> boxes_; // per primitive bounds, in leaf order
+  std::vector<int> order_;  // scratch for median splits
+  real build_cost_ = 0;
+};
+
+}
@@ -47,7 +47,7 @@ void Camera::ResetAspect(const float aspect) {
 
 void Camera::UpdateData() {
   if (proj_dirty_) {
-    float y_scale = 1.0f / std::tan(fovy_ / 2);
+    float y_scale = 1.0f / tan_half_fovy_;
     float x_scale = y_scale / aspect_;
     // opengl style: z \in [-1, 1]
     proj_ << x_scale, 0, 0, 0, 0, y_scale, 0, 0, 0, 0,
@@ -79,6 +79,7 @@ void Camera::LookAt(const Vec3f& pos, const Vec3f& target) {
 void Camera::SetPerspective(const float fovy, const float z_near,
                             const float z_far) {
   fovy_ = fovy;
+  tan_half_fovy_ = std::tan(fovy / 2);
   z_near_ = z_near;
   z_far_ = z_far;
   proj_dirty_ = true;
@@ -92,11 +93,27 @@ void Camera::SetSpherical(const float radius, const float phi,
   LookAt(SphericalToCartesian(radius, phi, theta) + target, target);
 }
 
-Ray Camera::GenerateRay(const real sx, const real sy) {
+Ray Camera::GenerateRay(const real sx, const real sy) const {
   const real tx = sx * 2 - 1;
   const real ty = sy * 2 - 1;
-  const real dy = tan(fovy_ / 2);
+  const real dy = tan_half_fovy_;
   const real dx = dy * aspect_;
   return Ray(pos_, lookat_ + ty * dy * up_ + tx * dx * right_);
 }
-};  // namespace VCL
\ No newline at end of file
+
+bool Camera::Project(const Vec3& pos, real& sx, real& sy) const {
+  const Vec3 d = pos - pos_;
+  const real z = d.dot(lookat_);
+  if (z <= 0) return false;
+  const real dy = tan_half_fovy_;
+  const real dx = dy * aspect_;
+  sx = (d.dot(right_) / (z * dx) + 1) / 2;
+  sy = (d.dot(up_) / (z * dy) + 1) / 2;
+  return true;
+}
+
+bool Camera::SameView(const Camera& other) const {
+  return pos_ == other.pos_ && lookat_ == other.lookat_ && up_ == other.up_ && right_ == other.right_ &&
+         fovy_ == other.fovy_ && aspect_ == other.aspect_;
+}
+};  // namespace VCL
@@ -11,6 +11,7 @@ class Camera {
   float z_far_;
   float fovy_;
   float aspect_;
+  float tan_half_fovy_;  // set with fovy_, spares GenerateRay the tan
 
   Vec3f pos_;
   Vec3f up_;
@@ -54,6 +55,10 @@ class Camera {
            radius;
   }
 
-  Ray GenerateRay(const real sx, const real sy); // sx, sy in [0, 1]
+  Ray GenerateRay(const real sx, const real sy) const; // sx, sy in [0, 1]
+  // inverse of GenerateRay; false behind the camera
+  bool Project(const Vec3& pos, real& sx, real& sy) const;
+  // whether both generate the same rays
+  bool SameView(const Camera& other) const;
 };
 };  // namespace VCL
\ No newline at end of file
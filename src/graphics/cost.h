@@ -0,0 +1,15 @@
+#pragma once
+
+namespace VCL {
+// Work done for one sample, and per pixel the mean over its samples. Counting
+// only happens while g_cost points at a Cost on the calling thread; the scene
+// and the kernels check the pointer and otherwise do nothing.
+struct Cost {
+  float ns_ = 0;           // wall time of the sample
+  float tests_ = 0;        // object intersection tests, instances and their members
+  float bounces_ = 0;      // surface hits along the path
+  float shadow_rays_ = 0;  // visibility rays towards lights and emitters
+};
+
+inline thread_local Cost *g_cost = nullptr;
+};  // namespace VCL
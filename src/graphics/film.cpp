@@ -0,0 +1,44 @@
+#include "film.h"
+
+namespace VCL {
+Film::Film(int width, int height) {
+  width_ = width;
+  height_ = height;
+  int size = width * height;
+  color_ = new Color[size];
+  cnt_ = new int[size];
+  Clear();
+}
+
+void Film::Clear() {
+  int size = width_ * height_;
+  for (int i = 0; i < size; ++i) {
+    color_[i] = Color::Zero();
+    cnt_[i] = 0;
+  }
+  if (aov_)
+    for (int i = 0; i < size; ++i) aov_[i] = Aov();
+  if (cost_)
+    for (int i = 0; i < size; ++i) cost_[i] = Cost();
+}
+
+void Film::Clear(int x0, int y0, int x1, int y1) {
+  for (int y = y0; y < y1; ++y) {
+    for (int x = x0; x < x1; ++x) {
+      const int i = y * width_ + x;
+      color_[i] = Color::Zero();
+      cnt_[i] = 0;
+      if (aov_) aov_[i] = Aov();
+      if (cost_) cost_[i] = Cost();
+    }
+  }
+}
+
+void Film::EnableAovs() {
+  if (!aov_) aov_ = new Aov[width_ * height_];
+}
+
+void Film::EnableCost() {
+  if (!cost_) cost_ = new Cost[width_ * height_];
+}
+};  // namespace VCL
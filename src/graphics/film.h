@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common/mathtype.h"
+#include "graphics/cost.h"
+
+namespace VCL {
+// first-hit data of one sample, averaged like the beauty pass
+struct Aov {
+  Color albedo_ = Color::Zero();
+  Vec3 normal_ = Vec3::Zero();
+  real depth_ = 0;  // distance along the camera ray, 0 on a miss
+};
+
+// float accumulation buffer, the only thing sampling threads write to
+class Film {
+ public:
+  int width_;
+  int height_;
+  Color* color_ = nullptr;  // running mean of the samples, row major
+  int* cnt_ = nullptr;
+  Aov* aov_ = nullptr;  // only allocated by EnableAovs
+  Cost* cost_ = nullptr;  // only allocated by EnableCost
+
+  Film(){};
+  Film(int width, int height);
+  ~Film() {
+    if (color_) delete[] color_;
+    if (cnt_) delete[] cnt_;
+    if (aov_) delete[] aov_;
+    if (cost_) delete[] cost_;
+  }
+  Film(const Film&) = delete;  // owns its buffers
+  Film& operator=(const Film&) = delete;
+  void Clear();
+  // only the pixels in [x0, x1) x [y0, y1)
+  void Clear(int x0, int y0, int x1, int y1);
+  void EnableAovs();
+  void EnableCost();
+
+  void AddSample(int x, int y, const Color& color) {
+    const int i = y * width_ + x;
+    color_[i] += (color - color_[i]) / (++cnt_[i]);
+  }
+
+  void AddSample(int x, int y, const Color& color, const Aov& aov) {
+    const int i = y * width_ + x;
+    AddSample(x, y, color);
+    const real w = real(1) / cnt_[i];
+    aov_[i].albedo_ += (aov.albedo_ - aov_[i].albedo_) * w;
+    aov_[i].normal_ += (aov.normal_ - aov_[i].normal_) * w;
+    aov_[i].depth_ += (aov.depth_ - aov_[i].depth_) * w;
+  }
+
+  // after AddSample, which counted the sample
+  void AddCost(int x, int y, const Cost& cost) {
+    const int i = y * width_ + x;
+    const float w = 1.0f / cnt_[i];
+    cost_[i].ns_ += (cost.ns_ - cost_[i].ns_) * w;
+    cost_[i].tests_ += (cost.tests_ - cost_[i].tests_) * w;
+    cost_[i].bounces_ += (cost.bounces_ - cost_[i].bounces_) * w;
+    cost_[i].shadow_rays_ += (cost.shadow_rays_ - cost_[i].shadow_rays_) * w;
+  }
+};
+};  // namespace VCL
@@ -1,116 +1,530 @@
 #include "globillum.h"
 
+#include "common/fastmath.h"
 #include "common/helperfunc.h"
+#include "cost.h"
 #include "light.h"
+#include "irradiancecache.h"
+#include "pathguide.h"
+#include "photonmap.h"
+#include "reservoir.h"
+#include "touchmap.h"
 
+#include <algorithm>
+#include <array>
+#include <utility>
 #include <iostream>
 
 namespace VCL::GlobIllum {
 
+template <bool Fast>
 Vec3 AxisAngle(const Vec3 &w, const real cos2theta, const real phi)
 {
 	const real cos_theta = std::sqrt(cos2theta);
 	const real sin_theta = std::sqrt(1 - cos2theta);
-	const Vec3 u = (std::abs(w[0]) > real(.1) ? Vec3(0, 1, 0) : Vec3(1, 0, 0)).cross(w).normalized();
+	const Vec3 u = Math::Normalized<Fast>((std::abs(w[0]) > real(.1) ? Vec3(0, 1, 0) : Vec3(1, 0, 0)).cross(w));
 	const Vec3 v = w.cross(u);
-	return (u * std::cos(phi) * sin_theta + v * std::sin(phi) * sin_theta + w * cos_theta).normalized();
+	real sin_phi, cos_phi;
+	Math::SinCos<Fast>(phi, sin_phi, cos_phi);
+	return Math::Normalized<Fast>(u * cos_phi * sin_theta + v * sin_phi * sin_theta + w * cos_theta);
 }
 
-Vec3 Sample(const Material *const mat, const Vec3 &n, const Vec3 &wi, Color &weight)
+template Vec3 AxisAngle<false>(const Vec3 &, const real, const real);
+template Vec3 AxisAngle<true>(const Vec3 &, const real, const real);
+
+// cosine weighted direction, mixed with the guide distribution if there is
+// one; `factor` is cos / pi over the pdf, which scales the diffuse weight
+template <bool Fast>
+Vec3 SampleDiffuse(const Vec3 &n, const PathGuide::Cell *guide, real &factor, real *pdf)
+{
+  if (!guide) {
+    const Vec3 d = AxisAngle<Fast>(n, rand01(), rand01() * 2 * PI_);
+    factor = 1;
+    if (pdf) *pdf = std::max(n.dot(d), real(0)) / PI_;
+    return d;
+  }
+  const Vec3 d = rand01() < PathGuide::kGuideProb ? guide->SampleDir() : AxisAngle<Fast>(n, rand01(), rand01() * 2 * PI_);
+  const real cos = n.dot(d);
+  const real p = cos > 0 ? PathGuide::kGuideProb * guide->Pdf(d) + (1 - PathGuide::kGuideProb) * cos / PI_ : 0;
+  factor = cos > 0 ? cos / PI_ / p : 0; // below the surface
+  if (pdf) *pdf = p;
+  return d;
+}
+
+template <bool Fast>
+Vec3 Sample(const CompiledMaterial &mat, const Vec3 &n, const Vec3 &wi, Color &weight, bool *diffuse,
+            const PathGuide::Cell *guide, real *pdf)
 {
-  const real R = mat->k_d_.mean() / (mat->k_d_.mean() + mat->k_s_.mean());
-  const real r0 = rand01();
-  if (r0 < R) { // sample diffuse ray
-    weight = mat->k_d_.any() ? mat->k_d_ / R : Color(0, 0, 0);
-    return AxisAngle(n, rand01(), rand01() * 2 * PI_);
+  if (diffuse) *diffuse = false;
+  real factor;
+  switch (mat.type_) {
+  case MaterialType::Diffuse: { // only one lobe, no selection needed
+    if (diffuse) *diffuse = true;
+    const Vec3 d = SampleDiffuse<Fast>(n, guide, factor, pdf);
+    weight = mat.diffuse_weight_ * factor;
+    return d;
   }
-  else { // sample specular ray
-    if (mat->alpha_ >= 0) {
-      const Vec3 d = AxisAngle(n * 2 * n.dot(wi) - wi, std::pow(rand01(), real(2) / (mat->alpha_ + 2)), rand01() * 2 * PI_);
-      weight = n.dot(d) <= 0 || !mat->k_s_.any() ? Color(0, 0, 0) : mat->k_s_ / (1 - R);
+  case MaterialType::Glossy:
+  case MaterialType::Mirror:
+    if (rand01() < mat.diffuse_prob_) { // sample diffuse ray
+      if (diffuse) *diffuse = true;
+      const Vec3 d = SampleDiffuse<Fast>(n, guide, factor, pdf);
+      weight = mat.diffuse_weight_ * factor;
       return d;
     }
-    else { // for ideal mirrors
-      weight = mat->k_s_.any() ? mat->k_s_ / (1 - R) : Color(0, 0, 0);
-      return n * 2 * n.dot(wi) - wi;
+    if (mat.type_ == MaterialType::Glossy) { // sample specular ray
+      const Vec3 d = AxisAngle<Fast>(n * 2 * n.dot(wi) - wi, Math::Pow<Fast>(rand01(), mat.lobe_exponent_),
+                                    rand01() * 2 * PI_);
+      weight = n.dot(d) <= 0 ? Color(0, 0, 0) : mat.specular_weight_;
+      return d;
     }
+    // for ideal mirrors
+    weight = mat.specular_weight_;
+    return n * 2 * n.dot(wi) - wi;
+  default: // emissive surfaces end the path before sampling
+    weight = Color::Zero();
+    return n;
   }
 }
 
-Color RayTrace(const Scene &scene, Ray ray)// eye-ray
+template Vec3 Sample<false>(const CompiledMaterial &, const Vec3 &, const Vec3 &, Color &, bool *,
+                            const PathGuide::Cell *, real *);
+template Vec3 Sample<true>(const CompiledMaterial &, const Vec3 &, const Vec3 &, Color &, bool *,
+                           const PathGuide::Cell *, real *);
+
+template <bool Fast>
+Color PhongLight(const CompiledMaterial &mat, const Vec3 &pos, const Vec3 &n, const Vec3 &dir, const Light &tlight)
 {
-  Color color(0, 0, 0);
-  Color weight(1, 1, 1);
-  std::vector<Light> lights;
+  //打到光球上，获得光线
+  Vec3 light = (tlight.position - pos).normalized();
+  Vec3 reflected_light =  2 * n * n.dot(light) - light;
+  Color l = tlight.intensity / (tlight.position - pos).dot(tlight.position - pos);
+  Color result = mat.k_d_ * l * (light.dot(n) > 0? light.dot(n):0); // diffuse
+  if (!mat.pure_diffuse_)
+    result += mat.k_s_ * l * Math::Pow<Fast>(reflected_light.dot(dir), mat.alpha_) ; // specular
+  return result;
+}
 
-  for (int depth = 0; depth < 10; depth++) {
-    lights.clear();//光线
-    Vec3 pos;
-    const Object *obj = scene.Intersect(ray, pos);// eye-ray，交点，物体
-    if (!obj) return color;
-    auto mat = obj->Mat();//物体材质
-    const Vec3 n = obj->ClosestNormal(pos);//物体法向
+template Color PhongLight<false>(const CompiledMaterial &, const Vec3 &, const Vec3 &, const Vec3 &, const Light &);
+template Color PhongLight<true>(const CompiledMaterial &, const Vec3 &, const Vec3 &, const Vec3 &, const Light &);
 
-    // Lights
-    for (const auto& tlight : scene.lights_) {// 场景中的光源，有两个
-      Vec3 test_pos;
-      const Ray test_ray(pos + 0.01 * (tlight->position - pos), (tlight->position - pos).normalized());// shadow ray
-      const Object * test_obj = scene.Intersect(test_ray, test_pos);
-      if (test_obj && test_obj->Mat()->emissive_) {//打到光球上，获得光线
-        lights.push_back(*tlight);
-      }
-    }
+// Radiance reaching `pos` from one uniformly picked emitter, weighted for a
+// Lambertian surface: Le * cos / pi * solid angle * number of emitters.
+template <bool Fast>
+Color SampleEmitter(const Scene &scene, const Vec3 &pos, const Vec3 &n)
+{
+  const int count = int(scene.emitters_.size());
+  const Emitter &e = scene.emitters_[std::min(int(rand01() * count), count - 1)];
+  if (g_touch.bits_) g_touch.map_->RecordObject(g_touch.bits_, e.top_, e.obj_);
+  if (e.n_.any()) {
+    // uniform point on the disk, its area converted to solid angle
+    const Vec3 p = e.cen_ + e.rad_ * std::sqrt(rand01()) * AxisAngle<Fast>(e.n_, 0, rand01() * 2 * PI_);
+    const Vec3 to_point = p - pos;
+    const real dist2 = to_point.squaredNorm();
+    const Vec3 dir = to_point / std::sqrt(dist2);
+    const real cos_n = dir.dot(n);
+    const real cos_e = -dir.dot(e.n_);
+    if (cos_n <= 0 || cos_e <= 0) return Color(0, 0, 0);
+    if (g_cost) g_cost->shadow_rays_++;
+    Hit hit;
+    if (!scene.Intersect(Ray(pos + 0.01 * dir, dir), hit) || hit.obj_ != e.obj_ || hit.top_ != e.top_)
+      return Color(0, 0, 0);
+    const real solid_angle = PI_ * e.rad_ * e.rad_ * cos_e / dist2;
+    return e.radiance_ * (cos_n / PI_ * solid_angle * count);
+  }
+
+  const Vec3 to_center = e.cen_ - pos;
+  const real dist2 = to_center.squaredNorm();
+  if (dist2 <= e.rad_ * e.rad_) return Color(0, 0, 0); // inside the emitter
+
+  // uniform direction in the cone subtended by the sphere
+  const real cos_max = std::sqrt(1 - e.rad_ * e.rad_ / dist2);
+  const real cos_theta = 1 - rand01() * (1 - cos_max);
+  const Vec3 dir = AxisAngle<Fast>(to_center / std::sqrt(dist2), cos_theta * cos_theta, rand01() * 2 * PI_);
+  const real cos_n = dir.dot(n);
+  if (cos_n <= 0) return Color(0, 0, 0);
+
+  if (g_cost) g_cost->shadow_rays_++;
+  Hit hit;
+  if (!scene.Intersect(Ray(pos + 0.01 * dir, dir), hit) || hit.obj_ != e.obj_ || hit.top_ != e.top_)
+    return Color(0, 0, 0);
+  const real solid_angle = 2 * PI_ * (1 - cos_max);
+  return e.radiance_ * (cos_n / PI_ * solid_angle * count);
+}
+
+namespace {
+// resampling weights are scalar
+real Target(const Color &c)
+{
+  const real y = real(0.2126) * c[0] + real(0.7152) * c[1] + real(0.0722) * c[2];
+  return y > 0 ? y : 0; // also for NaN
+}
+
+bool LightVisible(const Scene &scene, const Vec3 &pos, const Light &tlight)
+{
+  if (g_cost) g_cost->shadow_rays_++;
+  Vec3 test_pos;
+  const Ray test_ray(pos + 0.01 * (tlight.position - pos), (tlight.position - pos).normalized());// shadow ray
+  const Object * test_obj = scene.Intersect(test_ray, test_pos);
+  return test_obj && scene.Mat(test_obj).type_ == MaterialType::Emissive;//否则在阴影里
+}
+
+// Scene::lights_ shaded by the ray tracer, as a light set for ResampleDirect
+template <unsigned Features>
+struct PointLights
+{
+  const Scene &scene_;
+  const CompiledMaterial &mat_;
+  const Vec3 &pos_, &n_, &dir_;
+
+  int Count() const { return int(scene_.lights_.size()); }
+  // a uniformly picked light, returns the pdf of the pick
+  real Candidate(int &light, Vec3 &point) const
+  {
+    light = std::min(int(rand01() * Count()), Count() - 1);
+    point = scene_.lights_[light]->position;
+    return real(1) / Count();
+  }
+  Color Shade(int light, const Vec3 &) const
+  {
+    if (g_touch.bits_) g_touch.map_->RecordLight(g_touch.bits_, light);
+    return PhongLight<bool(Features & FAST_MATH)>(mat_, pos_, n_, dir_, *scene_.lights_[light]);
+  }
+  bool Visible(int light, const Vec3 &) const
+  {
+    if constexpr (Features & SHADOW_RAYS) return LightVisible(scene_, pos_, *scene_.lights_[light]);
+    return true;
+  }
+};
+
+// Scene::emitters_ for NEE at a Lambertian point. Candidates are points on
+// the emitters' surfaces, so that a sample stays valid at other shading
+// points; Shade is Le * cos / pi * cos_e / dist^2, the same estimate as
+// SampleEmitter once divided by the area pdf.
+template <bool Fast>
+struct AreaEmitters
+{
+  const Scene &scene_;
+  const Vec3 &pos_, &n_;
 
-    // Phong shading
-    Color result(0, 0, 0);
-    for(std::vector<Light>::iterator it = lights.begin(); it != lights.end(); ++it){//不在阴影里
-      Vec3 light = (it->position - pos).normalized();
-      Vec3 reflected_light =  2 * n * n.dot(light) - light;
-      Color l = it->intensity / (it->position - pos).dot(it->position - pos);
-      result += mat->k_d_ * l * (light.dot(n) > 0? light.dot(n):0); // diffuse
-      result += mat->k_s_ * l * std::pow (reflected_light.dot(ray.dir_),mat->alpha_) ; // specular
+  int Count() const { return int(scene_.emitters_.size()); }
+  real Candidate(int &light, Vec3 &point) const
+  {
+    light = std::min(int(rand01() * Count()), Count() - 1);
+    const Emitter &e = scene_.emitters_[light];
+    if (e.n_.any()) {
+      point = e.cen_ + e.rad_ * std::sqrt(rand01()) * AxisAngle<Fast>(e.n_, 0, rand01() * 2 * PI_);
+      return 1 / (Count() * PI_ * e.rad_ * e.rad_);
     }
-    result += scene.ambient_light_ * mat->k_d_;// ambient - 无论是否在阴影里
+    const real z = 1 - 2 * rand01();
+    const real r = std::sqrt(std::max(1 - z * z, real(0)));
+    const real phi = rand01() * 2 * PI_;
+    real sin_phi, cos_phi;
+    Math::SinCos<Fast>(phi, sin_phi, cos_phi);
+    point = e.cen_ + e.rad_ * Vec3(r * cos_phi, r * sin_phi, z);
+    return 1 / (Count() * 4 * PI_ * e.rad_ * e.rad_);
+  }
+  Color Shade(int light, const Vec3 &point) const
+  {
+    const Emitter &e = scene_.emitters_[light];
+    if (g_touch.bits_) g_touch.map_->RecordObject(g_touch.bits_, e.top_, e.obj_);
+    const Vec3 to_point = point - pos_;
+    const real dist2 = to_point.squaredNorm();
+    const Vec3 dir = to_point / std::sqrt(dist2);
+    const real cos_n = dir.dot(n_);
+    const real cos_e = -dir.dot(e.n_.any() ? e.n_ : Vec3((point - e.cen_) / e.rad_));
+    if (cos_n <= 0 || cos_e <= 0) return Color(0, 0, 0);
+    return e.radiance_ * (cos_n * cos_e / (PI_ * dist2));
+  }
+  bool Visible(int light, const Vec3 &point) const
+  {
+    const Emitter &e = scene_.emitters_[light];
+    const Vec3 dir = (point - pos_).normalized();
+    if (g_cost) g_cost->shadow_rays_++;
+    Hit hit;
+    return scene_.Intersect(Ray(pos_ + 0.01 * dir, dir), hit) && hit.obj_ == e.obj_ && hit.top_ == e.top_;
+  }
+};
 
-    // accumulate color
-    Color R = mat->k_s_ * 0.5;
-    color += weight * (Color(1, 1, 1) - R) * result;
-    weight *= R;
-    
-    // generate new ray
-    // reflected_ray  specularly reflective
-    ray.dir_ = ray.dir_ - 2 * ray.dir_.dot(n) * n;
-    ray.ori_ = pos + 0.00001 * ray.dir_;
+// Direct light at `pos` from one sample of `lights`, chosen among
+// ReservoirBuffer::kCandidates uniform candidates with probability
+// proportional to their unshadowed contribution. At the camera ray's first
+// hit the reservoirs of the previous pass at this pixel and at a few random
+// neighbours compete as well, if they were built for about the same surface;
+// their candidates count up to kMaxHistory each. Only the winner gets a
+// shadow ray. Reuse is biased where the neighbours see other lights, which
+// the geometry test keeps to soft shadows and edges.
+template <class Lights>
+Color ResampleDirect(const Lights &lights, const Vec3 &pos, const Vec3 &n, bool first_hit)
+{
+  if (!lights.Count()) return Color(0, 0, 0);
+  Reservoir r;
+  r.pos_ = pos;
+  r.n_ = n;
+  for (int i = 0; i < ReservoirBuffer::kCandidates; i++) {
+    int light;
+    Vec3 point;
+    const real pdf = lights.Candidate(light, point);
+    const real target = Target(lights.Shade(light, point));
+    r.Update(light, point, target / pdf, target, 1, rand01());
   }
 
-  return color;
+  const ReservoirPixel pixel = g_reservoir_pixel;
+  ReservoirBuffer *buffer = first_hit ? pixel.buffer_ : nullptr;
+  if (buffer) {
+    auto reuse = [&](const Reservoir &q) {
+      if (q.light_ < 0 || q.n_.dot(n) < real(0.9) || std::abs(n.dot(q.pos_ - pos)) > real(0.05)) return;
+      const real target = Target(lights.Shade(q.light_, q.point_));
+      const int m = std::min(q.m_, ReservoirBuffer::kMaxHistory);
+      r.Update(q.light_, q.point_, target * q.Weight() * m, target, m, rand01());
+    };
+    reuse(buffer->Previous(pixel.x_, pixel.y_));
+    for (int i = 0; i < ReservoirBuffer::kNeighbours; i++) {
+      const int x = pixel.x_ + int((2 * rand01() - 1) * ReservoirBuffer::kRadius);
+      const int y = pixel.y_ + int((2 * rand01() - 1) * ReservoirBuffer::kRadius);
+      if (x < 0 || y < 0 || x >= buffer->Width() || y >= buffer->Height()) continue;
+      reuse(buffer->Previous(x, y));
+    }
+  }
+
+  if (buffer) buffer->Store(pixel.x_, pixel.y_, r);
+  if (r.light_ < 0 || !lights.Visible(r.light_, r.point_)) return Color(0, 0, 0);
+  return lights.Shade(r.light_, r.point_) * r.Weight();
+}
 }
 
-Color PathTrace(const Scene &scene, Ray ray)
+// Phong shading of the point lights seen from `pos`, as in the ray tracer
+template <unsigned Features>
+Color Phong(const Scene &scene, const CompiledMaterial &mat, const Vec3 &pos, const Vec3 &n, const Vec3 &dir,
+            bool first_hit = false)
 {
-  Color color(1, 1, 1);
-  
-  for (int depth = 0; depth < 5; depth++) {
-    Vec3 pos;
-    const Object *obj = scene.Intersect(ray, pos);
-    if (!obj) {
-      return Color(0,0,0);
+  if constexpr (Features & RESAMPLED_DIRECT)
+    return ResampleDirect(PointLights<Features>{scene, mat, pos, n, dir}, pos, n, first_hit);
+  Color result(0, 0, 0);
+  for (size_t i = 0; i < scene.lights_.size(); i++) {// 场景中的光源
+    const Light &tlight = *scene.lights_[i];
+    if (g_touch.bits_) g_touch.map_->RecordLight(g_touch.bits_, int(i));
+    if constexpr (Features & SHADOW_RAYS) {
+      if (!LightVisible(scene, pos, tlight)) continue;
     }
-    if (obj->Mat()->emissive_) {
-      return color * obj->Mat()->k_d_;
+    result += PhongLight<bool(Features & FAST_MATH)>(mat, pos, n, dir, tlight);
+  }
+  return result;
+}
+
+// Mean incoming radiance at a diffuse point from the irradiance cache. Cells
+// that still take samples get one more: a cosine weighted ray whose hit is
+// shaded with direct light plus the cached indirect light there, so the
+// records pick up more bounces with every pass. Emitters count as black,
+// their light already comes from the point lights.
+template <unsigned Features>
+Color Indirect(const Scene &scene, const Vec3 &pos, const Vec3 &n)
+{
+  IrradianceCache &cache = *scene.irradiance_;
+  if (cache.Wants(pos, n)) {
+    const Vec3 d = AxisAngle<bool(Features & FAST_MATH)>(n, rand01(), rand01() * 2 * PI_);
+    Vec3 hit_pos, hit_n;
+    const Object *obj = scene.Intersect(Ray(pos + 0.01 * d, d), hit_pos, hit_n);
+    Color radiance(0, 0, 0);
+    if (obj && scene.Mat(obj).type_ != MaterialType::Emissive) {
+      const CompiledMaterial &mat = scene.Mat(obj);
+      radiance = mat.local_ * (Phong<Features>(scene, mat, hit_pos, hit_n, d) +
+                               cache.Lookup(hit_pos, hit_n, scene.ambient_light_) * mat.k_d_);
+    }
+    cache.Record(pos, n, radiance);
+  }
+  return cache.Lookup(pos, n, scene.ambient_light_);
+}
+
+template <Integrator I, int MaxDepth, unsigned Features>
+Color Trace(const Scene &scene, Ray ray, Aov *aov)
+{
+  constexpr bool kFast = Features & FAST_MATH;
+  if constexpr (I == Integrator::RayTrace) {
+    Color color(0, 0, 0);// eye-ray
+    Color weight(1, 1, 1);
+
+    for (int depth = 0; depth < MaxDepth; depth++) {
+      Vec3 pos, n;
+      const Object *obj = scene.Intersect(ray, pos, n);// eye-ray，交点，物体，物体法向
+      if (!obj) return color;
+      if (g_cost) g_cost->bounces_++;
+      const CompiledMaterial &mat = scene.Mat(obj);//物体材质
+      if (aov && depth == 0) *aov = {mat.k_d_, n, (pos - ray.ori_).norm()};
+
+      // Phong shading
+      Color result = Phong<Features>(scene, mat, pos, n, ray.dir_, depth == 0);
+      // ambient - 无论是否在阴影里; emitters keep the constant term, it is what makes them glow
+      if constexpr (Features & IRRADIANCE_CACHE) {
+        if (mat.type_ != MaterialType::Emissive && mat.k_d_.any())
+          result += Indirect<Features>(scene, pos, n) * mat.k_d_;// cached indirect diffuse
+        else
+          result += scene.ambient_light_ * mat.k_d_;
+      }
+      else {
+        result += scene.ambient_light_ * mat.k_d_;
+      }
+
+      // accumulate color
+      color += weight * mat.local_ * result;
+      if constexpr (!(Features & SPECULAR)) return color;
+      weight *= mat.reflectance_;
+      if (!weight.any()) return color;
+
+      // generate new ray
+      // reflected_ray  specularly reflective
+      ray.dir_ = ray.dir_ - 2 * ray.dir_.dot(n) * n;
+      ray.ori_ = pos + 0.00001 * ray.dir_;
     }
 
-    Color  weight(1,1,1);
-    ray.dir_ = Sample(obj->Mat(), obj->ClosestNormal(pos), -ray.dir_, weight);
-    ray.ori_ = pos + 0.01 * ray.dir_;
+    return color;
+  }
+  else {
+    Color color(1, 1, 1); // path throughput
+    Color radiance(0, 0, 0);
+    bool nee_done = false; // the previous vertex already sampled the emitters
+    bool gathered = false; // a diffuse vertex gathered the caustic photons
+    bool specular_since = false; // only specular bounces since that vertex
+
+    // diffuse vertices for the guide; what reaches them is known once the path ends
+    struct Vertex { Vec3 pos_, dir_; real pdf_; Color radiance_, throughput_; };
+    Vertex vertices[MaxDepth];
+    int num_vertices = 0;
+
+    for (int depth = 0; depth < MaxDepth; depth++) {
+      Vec3 pos, n;
+      const Object *obj = scene.Intersect(ray, pos, n);
+      if (!obj) {
+        break;
+      }
+      if (g_cost) g_cost->bounces_++;
+      const CompiledMaterial &mat = scene.Mat(obj);
+      if (aov && depth == 0) *aov = {mat.k_d_, n, (pos - ray.ori_).norm()};
+      if (mat.type_ == MaterialType::Emissive) {
+        // light - specular+ - diffuse paths are already in the photon map
+        if (!nee_done && !(gathered && specular_since)) radiance += color * mat.k_d_;
+        break;
+      }
 
-    if (!weight.any()) return weight;
-    else {
-      color *= weight;
+      Color  weight(1,1,1);
+      bool diffuse = true;
+      real pdf = 0;
+      const PathGuide::Cell *guide = nullptr;
+      if constexpr (Features & GUIDING) guide = scene.guide_->Find(pos);
+      if constexpr (Features & SPECULAR) {
+        ray.dir_ = Sample<kFast>(mat, n, -ray.dir_, weight, &diffuse, guide, &pdf);
+      }
+      else { // diffuse lobe only
+        real factor;
+        ray.dir_ = SampleDiffuse<kFast>(n, guide, factor, &pdf);
+        weight = mat.k_d_ * factor;
+      }
+      ray.ori_ = pos + 0.01 * ray.dir_;
+
+      if constexpr (Features & NEE) {
+        nee_done = diffuse && !scene.emitters_.empty();
+        if (nee_done) {
+          if constexpr (Features & RESAMPLED_DIRECT)
+            radiance += color * weight * ResampleDirect(AreaEmitters<kFast>{scene, pos, n}, pos, n, depth == 0);
+          else
+            radiance += color * weight * SampleEmitter<kFast>(scene, pos, n);
+        }
+      }
+      if constexpr (Features & CAUSTICS) {
+        if (diffuse) {
+          radiance += color * weight * scene.caustics_->Estimate(pos, n) / PI_;
+          gathered = true;
+          specular_since = false;
+        }
+        else specular_since = true;
+      }
+
+      if (!weight.any()) break;
+      else {
+        color *= weight;
+      }
+      if constexpr (Features & GUIDING) {
+        // the last vertex is never continued, it would only teach darkness
+        if (diffuse && depth + 1 < MaxDepth) vertices[num_vertices++] = {pos, ray.dir_, pdf, radiance, color};
+      }
+    }
+
+    if constexpr (Features & GUIDING) {
+      // radiance added after a vertex came in through its sampled direction,
+      // scaled by the throughput up to there
+      for (int i = 0; i < num_vertices; i++) {
+        const Vertex &v = vertices[i];
+        real incident = 0;
+        int channels = 0;
+        for (int c = 0; c < 3; c++) {
+          if (v.throughput_[c] <= 0) continue;
+          incident += (radiance[c] - v.radiance_[c]) / v.throughput_[c];
+          channels++;
+        }
+        if (channels) scene.guide_->Record(v.pos_, v.dir_, incident / channels, v.pdf_);
+      }
     }
+    return radiance;
   }
+}
+
+namespace {
+// every KernelFeature combination of `mask`, enumerated by the bits of `index`
+constexpr unsigned Expand(unsigned index, unsigned mask)
+{
+  unsigned features = 0;
+  for (unsigned bit = 1; mask; bit <<= 1) {
+    if (!(mask & bit)) continue;
+    if (index & 1) features |= bit;
+    index >>= 1;
+    mask &= ~bit;
+  }
+  return features;
+}
+
+constexpr unsigned Compress(unsigned features, unsigned mask)
+{
+  unsigned index = 0, shift = 0;
+  for (unsigned bit = 1; mask; bit <<= 1) {
+    if (!(mask & bit)) continue;
+    if (features & bit) index |= 1u << shift;
+    shift++;
+    mask &= ~bit;
+  }
+  return index;
+}
 
-  return Color(0,0,0);
+constexpr int Count(unsigned mask) { return mask ? int(mask & 1) + Count(mask >> 1) : 0; }
+
+template <Integrator I, int MaxDepth, unsigned Mask, size_t... Index>
+constexpr std::array<Kernel, sizeof...(Index)> Kernels(std::index_sequence<Index...>)
+{
+  return {&Trace<I, MaxDepth, Expand(Index, Mask)>...};
 }
 
-}
\ No newline at end of file
+constexpr unsigned kRayTraceFeatures = SHADOW_RAYS | SPECULAR | IRRADIANCE_CACHE | RESAMPLED_DIRECT | FAST_MATH;
+constexpr unsigned kPathTraceFeatures = SPECULAR | NEE | CAUSTICS | GUIDING | RESAMPLED_DIRECT | FAST_MATH;
+}
+
+Kernel SelectKernel(const bool MonteCarlo, unsigned features)
+{
+  // every supported variant is instantiated here, once
+  static constexpr auto ray_trace =
+    Kernels<Integrator::RayTrace, 10, kRayTraceFeatures>(std::make_index_sequence<1 << Count(kRayTraceFeatures)>());
+  static constexpr auto path_trace =
+    Kernels<Integrator::PathTrace, 5, kPathTraceFeatures>(std::make_index_sequence<1 << Count(kPathTraceFeatures)>());
+  if (!MonteCarlo) return ray_trace[Compress(features, kRayTraceFeatures)];
+  return path_trace[Compress(features, kPathTraceFeatures)];
+}
+
+Color RayTrace(const Scene &scene, Ray ray, Aov *aov)
+{
+  return Trace<Integrator::RayTrace, 10, SHADOW_RAYS | SPECULAR>(scene, ray, aov);
+}
+
+Color PathTrace(const Scene &scene, Ray ray, Aov *aov)
+{
+  return Trace<Integrator::PathTrace, 5, SPECULAR>(scene, ray, aov);
+}
+
+}
@@ -1,8 +1,61 @@
+#pragma once
+
+#include "graphics/film.h"
+#include "graphics/pathguide.h"
 #include "graphics/scene.h"
 
 namespace VCL::GlobIllum {
 
-Color RayTrace(const Scene &scene, Ray ray);
-Color PathTrace(const Scene &scene, Ray ray);
+// direction around `w` with the given squared polar cosine and azimuth;
+// a uniform cos2theta gives a cosine weighted hemisphere. `Fast` uses the
+// approximations of common/fastmath.h, as the FAST_MATH kernels do.
+template <bool Fast = false>
+Vec3 AxisAngle(const Vec3 &w, const real cos2theta, const real phi);
+
+// `diffuse`, if given, tells whether the diffuse lobe was picked. With a
+// trained `guide` cell the diffuse lobe mixes guided and cosine sampling;
+// `pdf`, if given, receives the solid angle pdf of a diffuse direction.
+template <bool Fast = false>
+Vec3 Sample(const CompiledMaterial &mat, const Vec3 &n, const Vec3 &wi, Color &weight, bool *diffuse = nullptr,
+            const PathGuide::Cell *guide = nullptr, real *pdf = nullptr);
+
+// unshadowed Phong term of the point light `tlight` at `pos`, seen along
+// `dir`; shared by the ray tracing kernels and the wavefront integrator
+template <bool Fast = false>
+Color PhongLight(const CompiledMaterial &mat, const Vec3 &pos, const Vec3 &n, const Vec3 &dir, const Light &tlight);
+
+enum class Integrator : unsigned char { RayTrace = 0, PathTrace };
+
+enum KernelFeature : unsigned {
+  SHADOW_RAYS = 1, // ray tracing: test light visibility, otherwise lights are never occluded
+  SPECULAR = 2,    // follow specular reflections / sample the specular lobes
+  NEE = 4,         // path tracing: sample the emitters at diffuse vertices
+  CAUSTICS = 8,    // path tracing: gather scene.caustics_ at diffuse vertices
+  IRRADIANCE_CACHE = 16, // ray tracing: scene.irradiance_ replaces the constant ambient term
+  GUIDING = 32,    // path tracing: learn and sample scene.guide_ at diffuse vertices
+  // the point lights (ray tracing) or NEE (path tracing): one light chosen by
+  // resampling candidates, at the camera ray's first hit also the reservoirs
+  // of the previous pass around the pixel (see ReservoirBuffer); one shadow ray
+  RESAMPLED_DIRECT = 64,
+  // pow, sin, cos and normalization of the shading and sampling code from
+  // common/fastmath.h instead of libm; errors are listed there
+  FAST_MATH = 128,
+};
+
+// Integrator kernel specialized at compile time on the integrator, the
+// maximum path depth and a set of KernelFeature flags. `aov`, if given,
+// receives the first hit of the camera ray.
+template <Integrator I, int MaxDepth, unsigned Features>
+Color Trace(const Scene &scene, Ray ray, Aov *aov = nullptr);
+
+using Kernel = Color (*)(const Scene &scene, Ray ray, Aov *aov);
+
+// picks the instantiated kernel once at startup; flags that do not apply to
+// the integrator are ignored
+Kernel SelectKernel(const bool MonteCarlo, unsigned features);
+
+// the default kernels of both modes
+Color RayTrace(const Scene &scene, Ray ray, Aov *aov = nullptr);
+Color PathTrace(const Scene &scene, Ray ray, Aov *aov = nullptr);
 
 }
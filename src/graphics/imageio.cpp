@@ -0,0 +1,189 @@
+#include "imageio.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace VCL {
+namespace {
+bool EndsWith(const std::string& s, const char* suffix) {
+  const size_t n = std::strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// rounds to nearest, overflows to inf, flushes values below the half range to 0
+uint16_t FloatToHalf(float f) {
+  uint32_t x;
+  std::memcpy(&x, &f, 4);
+  const uint32_t sign = (x >> 16) & 0x8000;
+  const int32_t exp = int32_t((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mant = x & 0x7fffff;
+  if (((x >> 23) & 0xff) == 0xff) return uint16_t(sign | 0x7c00 | (mant ? 0x200 : 0));
+  if (exp >= 31) return uint16_t(sign | 0x7c00);
+  if (exp <= 0) {
+    if (exp < -10) return uint16_t(sign);
+    mant |= 0x800000;
+    const int shift = 14 - exp;
+    uint32_t h = mant >> shift;
+    if ((mant >> (shift - 1)) & 1) h++;
+    return uint16_t(sign | h);
+  }
+  uint32_t h = sign | (uint32_t(exp) << 10) | (mant >> 13);
+  if (mant & 0x1000) h++;  // may carry into the exponent, which is still correct
+  return uint16_t(h);
+}
+
+struct File {
+  FILE* f_;
+  explicit File(const std::string& path) : f_(std::fopen(path.c_str(), "wb")) {}
+  ~File() {
+    if (f_) std::fclose(f_);
+  }
+};
+
+template <class T>
+void Put(std::vector<unsigned char>& out, const T& v) {
+  const unsigned char* p = (const unsigned char*)&v;
+  out.insert(out.end(), p, p + sizeof(T));  // EXR is little endian, like our targets
+}
+
+void PutString(std::vector<unsigned char>& out, const char* s) {
+  out.insert(out.end(), s, s + std::strlen(s) + 1);
+}
+
+void PutAttribute(std::vector<unsigned char>& out, const char* name, const char* type,
+                  const std::vector<unsigned char>& value) {
+  PutString(out, name);
+  PutString(out, type);
+  Put(out, int32_t(value.size()));
+  out.insert(out.end(), value.begin(), value.end());
+}
+}  // namespace
+
+bool WritePFM(const std::string& path, int width, int height, int channels, const float* pixels) {
+  File file(path);
+  if (!file.f_) return false;
+  // negative scale marks little endian; PFM rows are bottom-up already
+  std::fprintf(file.f_, "PF\n%d %d\n-1.0\n", width, height);
+  std::vector<float> row(size_t(width) * 3);
+  for (int r = 0; r < height; ++r) {
+    for (int c = 0; c < width; ++c)
+      for (int k = 0; k < 3; ++k) row[3 * c + k] = pixels[(size_t(r) * width + c) * channels + (k < channels ? k : 0)];
+    if (std::fwrite(row.data(), sizeof(float), row.size(), file.f_) != row.size()) return false;
+  }
+  return true;
+}
+
+bool WriteHDR(const std::string& path, int width, int height, int channels, const float* pixels) {
+  File file(path);
+  if (!file.f_) return false;
+  std::fprintf(file.f_, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+  // flat (not run-length encoded) scanlines, top row first
+  std::vector<unsigned char> row(size_t(width) * 4);
+  for (int r = height - 1; r >= 0; --r) {
+    for (int c = 0; c < width; ++c) {
+      const float* p = &pixels[(size_t(r) * width + c) * channels];
+      float rgb[3];
+      for (int k = 0; k < 3; ++k) rgb[k] = std::max(p[k < channels ? k : 0], 0.0f);
+      const float v = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+      unsigned char* rgbe = &row[4 * c];
+      if (v < 1e-32f) {
+        rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+      } else {
+        int e;
+        const float scale = std::frexp(v, &e) * 256.0f / v;
+        for (int k = 0; k < 3; ++k) rgbe[k] = (unsigned char)(rgb[k] * scale);
+        rgbe[3] = (unsigned char)(e + 128);
+      }
+    }
+    if (std::fwrite(row.data(), 1, row.size(), file.f_) != row.size()) return false;
+  }
+  return true;
+}
+
+bool WriteEXR(const std::string& path, int width, int height, int channels, const float* pixels) {
+  File file(path);
+  if (!file.f_) return false;
+  // channels are stored in alphabetical order
+  static const char* const rgba_names[] = {"A", "B", "G", "R"};
+  static const int rgba_src[] = {3, 2, 1, 0};
+  static const char* const y_names[] = {"Y"};
+  static const int y_src[] = {0};
+  const bool gray = channels == 1;
+  const int num = gray ? 1 : (channels >= 4 ? 4 : 3);
+  const char* const* names = gray ? y_names : rgba_names + (4 - num);
+  const int* src = gray ? y_src : rgba_src + (4 - num);
+
+  std::vector<unsigned char> header;
+  Put(header, int32_t(20000630));  // magic
+  Put(header, int32_t(2));         // version 2, single part scanline
+
+  std::vector<unsigned char> value;
+  for (int k = 0; k < num; ++k) {
+    PutString(value, names[k]);
+    Put(value, int32_t(1));  // HALF
+    Put(value, int32_t(0));  // pLinear + reserved
+    Put(value, int32_t(1));  // x sampling
+    Put(value, int32_t(1));  // y sampling
+  }
+  value.push_back(0);
+  PutAttribute(header, "channels", "chlist", value);
+  PutAttribute(header, "compression", "compression", {0});
+  value.clear();
+  for (int32_t v : {0, 0, width - 1, height - 1}) Put(value, v);
+  PutAttribute(header, "dataWindow", "box2i", value);
+  PutAttribute(header, "displayWindow", "box2i", value);
+  PutAttribute(header, "lineOrder", "lineOrder", {0});
+  value.clear();
+  Put(value, 1.0f);
+  PutAttribute(header, "pixelAspectRatio", "float", value);
+  value.clear();
+  Put(value, 0.0f);
+  Put(value, 0.0f);
+  PutAttribute(header, "screenWindowCenter", "v2f", value);
+  value.clear();
+  Put(value, 1.0f);
+  PutAttribute(header, "screenWindowWidth", "float", value);
+  header.push_back(0);
+
+  // one scanline per chunk, offsets are absolute file positions
+  const int32_t line_bytes = int32_t(width) * num * 2;
+  const uint64_t first = header.size() + size_t(height) * 8;
+  for (int y = 0; y < height; ++y) Put(header, uint64_t(first + uint64_t(y) * (8 + line_bytes)));
+  if (std::fwrite(header.data(), 1, header.size(), file.f_) != header.size()) return false;
+
+  std::vector<unsigned char> line;
+  for (int y = 0; y < height; ++y) {
+    line.clear();
+    Put(line, int32_t(y));
+    Put(line, line_bytes);
+    const int r = height - 1 - y;  // EXR y grows downwards
+    for (int k = 0; k < num; ++k)
+      for (int c = 0; c < width; ++c)
+        Put(line, FloatToHalf(pixels[(size_t(r) * width + c) * channels + src[k]]));
+    if (std::fwrite(line.data(), 1, line.size(), file.f_) != line.size()) return false;
+  }
+  return true;
+}
+
+bool WritePNG(const std::string& path, int width, int height, int channels, const unsigned char* pixels) {
+  const size_t stride = size_t(width) * channels;
+  std::vector<unsigned char> flipped(stride * height);
+  for (int r = 0; r < height; ++r)
+    std::memcpy(&flipped[(height - 1 - r) * stride], &pixels[r * stride], stride);
+  return stbi_write_png(path.c_str(), width, height, channels, flipped.data(), int(stride)) != 0;
+}
+
+bool WriteFloatImage(const std::string& path, int width, int height, int channels, const float* pixels) {
+  if (EndsWith(path, ".pfm")) return WritePFM(path, width, height, channels, pixels);
+  if (EndsWith(path, ".hdr")) return WriteHDR(path, width, height, channels, pixels);
+  if (EndsWith(path, ".exr")) return WriteEXR(path, width, height, channels, pixels);
+  return false;
+}
+}  // namespace VCL
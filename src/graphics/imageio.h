@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace VCL {
+// Image file writers. Pixels are interleaved with `channels` components and
+// rows stored bottom-up, the same layout as Film and Framebuffer.
+// Each returns false if the file could not be written.
+
+// linear float: Portable Float Map (.pfm, RGB)
+bool WritePFM(const std::string& path, int width, int height, int channels, const float* pixels);
+// linear float: Radiance RGBE (.hdr)
+bool WriteHDR(const std::string& path, int width, int height, int channels, const float* pixels);
+// linear half float: uncompressed scanline OpenEXR (.exr)
+bool WriteEXR(const std::string& path, int width, int height, int channels, const float* pixels);
+// display referred 8-bit: PNG (.png)
+bool WritePNG(const std::string& path, int width, int height, int channels, const unsigned char* pixels);
+
+// picks the float writer from the extension of `path`
+bool WriteFloatImage(const std::string& path, int width, int height, int channels, const float* pixels);
+}  // namespace VCL
@@ -0,0 +1,46 @@
+#include "instance.h"
+#include "cost.h"
+
+namespace VCL {
+
+void Prototype::Build()
+{
+  std::vector<const Object *> objs;
+  for (const auto &object : objs_) objs.push_back(object.get());
+  bvh_.Build(objs);
+}
+
+bool Prototype::Intersect(const Ray &ray, Hit &hit) const
+{
+  bool found = false;
+  Cost *cost = g_cost;
+  bvh_.Traverse(ray, hit.t_, [&](const Object *obj) {
+    if (cost) cost->tests_++;
+    found |= obj->Intersect(ray, hit);
+  });
+  return found;
+}
+
+bool Instance::Intersect(const Ray &ray, Hit &hit) const
+{
+  Ray local = ray;
+  local.ori_ = inv_ * ray.ori_;
+  local.dir_ = inv_.linear() * ray.dir_;
+  if (!proto_->Intersect(local, hit)) return false;
+  hit.top_ = this;
+  return true;
+}
+
+AABB Instance::Bounds() const
+{
+  const AABB local = proto_->Bounds();
+  AABB box;
+  if (!local.Bounded()) return AABB::Infinite();
+  for (int i = 0; i < 8; i++)
+    box.Extend(xf_ * Vec3(i & 1 ? local.max_[0] : local.min_[0],
+                          i & 2 ? local.max_[1] : local.min_[1],
+                          i & 4 ? local.max_[2] : local.min_[2]));
+  return box;
+}
+
+}
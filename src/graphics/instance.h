@@ -0,0 +1,99 @@
+#pragma once
+
+#include "graphics/bvh.h"
+
+#include <memory>
+#include <vector>
+
+namespace VCL {
+
+// A group of objects in its own object space, shared by any number of
+// instances. Prototypes hold plain objects only, instances do not nest.
+class Prototype
+{
+public:
+
+  std::vector<std::unique_ptr<Object>> objs_;
+
+public:
+
+  // call after the objects are added
+  void Build();
+
+  AABB Bounds() const { return bvh_.Bounds(); }
+
+  BVH &Bvh() { return bvh_; }
+  const BVH &Bvh() const { return bvh_; }
+
+  bool Intersect(const Ray &ray, Hit &hit) const;
+
+private:
+
+  BVH bvh_;
+};
+
+// A prototype placed in the scene with an affine transform. Rays are moved
+// into object space for traversal; their directions are not renormalized,
+// so hit distances are the same in both spaces.
+class Instance : public Object
+{
+protected:
+
+  const Prototype *proto_;
+  Affine3 xf_;     // object to world
+  Affine3 inv_;    // world to object
+  Mat3 normal_xf_; // inverse transpose of the linear part
+
+public:
+
+  Instance(const Prototype *proto, const Affine3 &xf) :
+    Object(nullptr),
+    proto_(proto),
+    xf_(xf),
+    inv_(xf.inverse()),
+    normal_xf_(xf.linear().inverse().transpose())
+  { }
+
+  virtual ~Instance() = default;
+
+  const Prototype *Proto() const { return proto_; }
+  const Affine3 &Transform() const { return xf_; }
+
+  // the scene BVH has to be refit afterwards, see Scene::Animate
+  void SetTransform(const Affine3 &xf)
+  {
+    xf_ = xf;
+    inv_ = xf.inverse();
+    normal_xf_ = xf.linear().inverse().transpose();
+  }
+
+  virtual real Intersect(const Ray &ray) const override
+  {
+    Hit hit;
+    Intersect(ray, hit);
+    return hit.t_;
+  }
+
+  virtual bool Intersect(const Ray &ray, Hit &hit) const override;
+
+  // instances only report normals through HitNormal, the position alone
+  // does not tell which member was hit
+  virtual Vec3 ClosestNormal(const Vec3 &/*pos*/) const override { return Vec3::Zero(); }
+
+  virtual Vec3 HitNormal(const Hit &hit) const override
+  {
+    return (normal_xf_ * hit.obj_->ClosestNormal(hit.local_)).normalized();
+  }
+
+  virtual AABB Bounds() const override;
+
+  // the transform, column major; SceneCache fills in proto_
+  virtual ObjectRecord Record() const override
+  {
+    ObjectRecord record{ObjectType::Instance};
+    Eigen::Map<Eigen::Matrix<float, 3, 4>>(record.p_) = xf_.affine();
+    return record;
+  }
+};
+
+}
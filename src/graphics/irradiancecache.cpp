@@ -0,0 +1,109 @@
+#include "irradiancecache.h"
+
+#include <cmath>
+
+namespace VCL {
+
+IrradianceCache::IrradianceCache(real cell, int max_samples, int min_samples) :
+  cell_(cell),
+  max_samples_(max_samples),
+  min_samples_(min_samples),
+  table_(1 << 12)
+{ }
+
+int IrradianceCache::Side(const Vec3 &n) const
+{
+  int axis;
+  n.cwiseAbs().maxCoeff(&axis);
+  return 2 * axis + (n[axis] < 0);
+}
+
+uint64_t IrradianceCache::Key(int x, int y, int z, int side) const
+{
+  // 20 bits per coordinate, 3 for the side, never 0
+  const uint64_t mask = (1 << 20) - 1;
+  return ((uint64_t(x) & mask) << 43) | ((uint64_t(y) & mask) << 23) | ((uint64_t(z) & mask) << 3) | uint64_t(side + 1);
+}
+
+const IrradianceCache::Entry *IrradianceCache::Find(uint64_t key) const
+{
+  const size_t mask = table_.size() - 1;
+  for (size_t i = (key * 0x9E3779B97F4A7C15ull) >> 20 & mask;; i = (i + 1) & mask) {
+    if (table_[i].key_ == key) return &table_[i];
+    if (table_[i].key_ == 0) return nullptr;
+  }
+}
+
+IrradianceCache::Entry &IrradianceCache::Insert(uint64_t key)
+{
+  if (2 * (size_ + 1) > int(table_.size())) {
+    // keep the load factor below 1/2
+    std::vector<Entry> old(table_.size() * 2);
+    old.swap(table_);
+    size_ = 0;
+    for (const Entry &e : old)
+      if (e.key_) Insert(e.key_) = e;
+  }
+  const size_t mask = table_.size() - 1;
+  size_t i = (key * 0x9E3779B97F4A7C15ull) >> 20 & mask;
+  while (table_[i].key_ != key && table_[i].key_ != 0) i = (i + 1) & mask;
+  if (table_[i].key_ == 0) {
+    table_[i].key_ = key;
+    size_++;
+  }
+  return table_[i];
+}
+
+bool IrradianceCache::Wants(const Vec3 &pos, const Vec3 &n) const
+{
+  const Vec3 c = pos / cell_;
+  const Entry *e = Find(Key(int(std::floor(c[0])), int(std::floor(c[1])), int(std::floor(c[2])), Side(n)));
+  return !e || e->count_ < max_samples_;
+}
+
+void IrradianceCache::Record(const Vec3 &pos, const Vec3 &n, const Color &radiance)
+{
+  const Vec3 c = pos / cell_;
+  pending_.Push({Key(int(std::floor(c[0])), int(std::floor(c[1])), int(std::floor(c[2])), Side(n)), radiance});
+}
+
+Color IrradianceCache::Lookup(const Vec3 &pos, const Vec3 &n, const Color &fallback) const
+{
+  // cell centers sit at (i + 0.5) * cell_
+  const Vec3 c = pos / cell_ - Vec3::Constant(0.5);
+  const Vec3 base = c.array().floor();
+  const Vec3 f = c - base;
+  const int side = Side(n);
+  Color sum(0, 0, 0);
+  real weight = 0;
+  for (int k = 0; k < 8; k++) {
+    const int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+    const Entry *e = Find(Key(int(base[0]) + dx, int(base[1]) + dy, int(base[2]) + dz, side));
+    if (!e || e->count_ < min_samples_) continue;
+    const real w = (dx ? f[0] : 1 - f[0]) * (dy ? f[1] : 1 - f[1]) * (dz ? f[2] : 1 - f[2]);
+    sum += w * e->sum_ / real(e->count_);
+    weight += w;
+  }
+  return weight > 0 ? Color(sum / weight) : fallback;
+}
+
+void IrradianceCache::Commit()
+{
+  // Wants only sees the committed counts, so a cell can collect a whole
+  // pass worth of samples past the cap; those are dropped here
+  pending_.Drain([this](const Sample &s) {
+    Entry &e = Insert(s.key_);
+    if (e.count_ >= max_samples_) return;
+    e.sum_ += s.radiance_;
+    e.count_++;
+  });
+}
+
+void IrradianceCache::Clear()
+{
+  for (Entry &e : table_) e = Entry();
+  size_ = 0;
+  pending_.Clear();
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common/mathtype.h"
+#include "graphics/passbuffer.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace VCL {
+
+// World space hash grid of indirect diffuse light for the ray tracer.
+// A record holds the mean cosine weighted incoming radiance of one grid
+// cell and one of six normal directions, so it can stand in for
+// Scene::ambient_light_. Shading points add hemisphere samples to their
+// cell until it has enough of them; lookups interpolate trilinearly between
+// the eight surrounding cells.
+// Records persist across passes. During a pass the table is read only and
+// new samples go to a PassBuffer, which Commit merges afterwards.
+class IrradianceCache
+{
+public:
+
+  explicit IrradianceCache(real cell, int max_samples = 64, int min_samples = 8);
+
+  // whether the cell at `pos` still takes samples
+  bool Wants(const Vec3 &pos, const Vec3 &n) const;
+
+  // adds one sample of the incoming radiance at `pos`, thread safe
+  void Record(const Vec3 &pos, const Vec3 &n, const Color &radiance);
+
+  // interpolated mean incoming radiance, `fallback` where nothing is cached yet
+  Color Lookup(const Vec3 &pos, const Vec3 &n, const Color &fallback) const;
+
+  // room for `samples` Record calls in the next pass, more are dropped;
+  // not thread safe
+  void Reserve(int samples) { pending_.Reserve(samples); }
+
+  // merges the samples recorded since the last call; not thread safe
+  void Commit();
+
+  // drops all records, e.g. after the scene changed
+  void Clear();
+
+  int Size() const { return size_; }
+
+private:
+
+  struct Entry
+  {
+    uint64_t key_ = 0; // 0 marks an empty slot
+    Color sum_ = Color::Zero();
+    int count_ = 0;
+  };
+
+  struct Sample
+  {
+    uint64_t key_;
+    Color radiance_;
+  };
+
+  uint64_t Key(int x, int y, int z, int side) const;
+  int Side(const Vec3 &n) const;
+  const Entry *Find(uint64_t key) const;
+  Entry &Insert(uint64_t key);
+
+private:
+
+  const real cell_;
+  const int max_samples_;
+  const int min_samples_;
+
+  std::vector<Entry> table_; // open addressing, power of two size
+  int size_ = 0;
+  PassBuffer<Sample> pending_;
+};
+
+}
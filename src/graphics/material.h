@@ -31,4 +31,51 @@ public:
   virtual ~Material() = default;
 };
 
+enum class MaterialType : unsigned char { Emissive = 0, Diffuse, Glossy, Mirror };
+
+// Flattened material, built once by Scene::Compile and addressed by
+// Object::mat_id_. Everything the integrators used to derive per bounce
+// is precomputed here.
+struct CompiledMaterial
+{
+  MaterialType type_;
+  bool pure_diffuse_; // no specular lobe at all
+
+  Color k_d_; // also the radiance of emissive materials
+  Color k_s_;
+  real alpha_;
+
+  real diffuse_prob_;      // probability of sampling the diffuse lobe
+  Color diffuse_weight_;   // k_d_ / diffuse_prob_, or 0
+  Color specular_weight_;  // k_s_ / (1 - diffuse_prob_), or 0
+  real lobe_exponent_;     // 2 / (alpha_ + 2), for sampling the Phong lobe
+
+  // ray-tracing mode: fraction of the light reflected to the next bounce
+  Color reflectance_;      // k_s_ / 2
+  Color local_;            // 1 - reflectance_
+
+  static CompiledMaterial Compile(const Material &mat)
+  {
+    CompiledMaterial m;
+    m.k_d_ = mat.k_d_;
+    m.k_s_ = mat.k_s_;
+    m.alpha_ = mat.alpha_;
+    m.pure_diffuse_ = !mat.k_s_.any();
+    if (mat.emissive_) m.type_ = MaterialType::Emissive;
+    else if (m.pure_diffuse_) m.type_ = MaterialType::Diffuse;
+    else if (mat.alpha_ < 0) m.type_ = MaterialType::Mirror;
+    else m.type_ = MaterialType::Glossy;
+
+    const real sum = mat.k_d_.mean() + mat.k_s_.mean();
+    m.diffuse_prob_ = sum > 0 ? mat.k_d_.mean() / sum : 0;
+    m.diffuse_weight_ = mat.k_d_.any() && m.diffuse_prob_ > 0 ? Color(mat.k_d_ / m.diffuse_prob_) : Color::Zero();
+    m.specular_weight_ = mat.k_s_.any() && m.diffuse_prob_ < 1 ? Color(mat.k_s_ / (1 - m.diffuse_prob_)) : Color::Zero();
+    m.lobe_exponent_ = mat.alpha_ >= 0 ? real(2) / (mat.alpha_ + 2) : 0;
+
+    m.reflectance_ = mat.k_s_ * 0.5;
+    m.local_ = Color(1, 1, 1) - m.reflectance_;
+    return m;
+  }
+};
+
 }
@@ -2,13 +2,55 @@
 
 #include "graphics/material.h"
 
+#include <algorithm>
+#include <cstdint>
+
 namespace VCL {
 
+// axis aligned bounding box, empty by default
+struct AABB
+{
+  Vec3 min_ = Vec3::Constant(std::numeric_limits<real>::infinity());
+  Vec3 max_ = Vec3::Constant(-std::numeric_limits<real>::infinity());
+
+  static AABB Infinite() { return {-Vec3::Constant(std::numeric_limits<real>::infinity()), Vec3::Constant(std::numeric_limits<real>::infinity())}; }
+
+  bool Bounded() const { return min_.allFinite() && max_.allFinite(); }
+  Vec3 Center() const { return (min_ + max_) / 2; }
+  void Extend(const Vec3 &p) { min_ = min_.cwiseMin(p); max_ = max_.cwiseMax(p); }
+  void Extend(const AABB &b) { min_ = min_.cwiseMin(b.min_); max_ = max_.cwiseMax(b.max_); }
+  real Area() const { const Vec3 d = (max_ - min_).cwiseMax(0); return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]); }
+};
+
+class Object;
+
+enum class ObjectType : uint32_t { Plane = 0, Sphere, CapeOutside, CapeInside, Cube, Instance, Quad, Disk };
+
+// constructor arguments of an object in flat form, stored by SceneCache
+struct ObjectRecord
+{
+  ObjectType type_;
+  int32_t mat_ = -1;   // index into Scene::mat_table_
+  int32_t proto_ = -1; // instances: position of the prototype in Scene::protos_
+  float p_[12] = {};
+};
+
+// closest hit along a ray
+struct Hit
+{
+  real t_ = std::numeric_limits<real>::infinity();
+  const Object *obj_ = nullptr; // primitive that was hit, carries the material
+  const Object *top_ = nullptr; // scene level object: obj_ itself or the instance holding it
+  Vec3 local_;                  // hit position in the space of obj_
+};
+
 class Object
 {
 public:
 
   const Material *mat_;
+  int mat_id_ = -1; // index into Scene::mat_table_, set by Scene::Compile
+  int id_ = -1;     // position in Scene::objs_, set by Scene::Compile; -1 in prototypes
 
 public:
 
@@ -17,10 +59,30 @@ public:
   virtual ~Object() = default;
 
   const Material *Mat() const { return mat_; }
+  int MatId() const { return mat_id_; }
 
   virtual real Intersect(const Ray &ray) const = 0;
 
   virtual Vec3 ClosestNormal(const Vec3 &pos) const = 0;
+
+  // unbounded objects (planes) are kept out of the BVH
+  virtual AABB Bounds() const { return AABB::Infinite(); }
+
+  // updates `hit` if this object is hit closer than hit.t_
+  virtual bool Intersect(const Ray &ray, Hit &hit) const
+  {
+    const real t = Intersect(ray);
+    if (!(t < hit.t_)) return false;
+    hit.t_ = t;
+    hit.obj_ = hit.top_ = this;
+    hit.local_ = ray.ori_ + ray.dir_ * t;
+    return true;
+  }
+
+  // world space normal of a hit reported by this object
+  virtual Vec3 HitNormal(const Hit &hit) const { return hit.obj_->ClosestNormal(hit.local_); }
+
+  virtual ObjectRecord Record() const = 0;
 };
 
 class Plane : public Object
@@ -51,6 +113,123 @@ public:
   }
 
   virtual Vec3 ClosestNormal(const Vec3 &position) const { return n_; }
+
+  virtual ObjectRecord Record() const override
+  {
+    return {ObjectType::Plane, mat_id_, -1, {pos_[0], pos_[1], pos_[2], n_[0], n_[1], n_[2]}};
+  }
+};
+
+// parallelogram `corner` + a * u + b * v with a, b in [0, 1]; like Plane it
+// is only hit from the front, the side u x v points to
+class Quad : public Object
+{
+protected:
+
+  const Vec3 corner_;
+  const Vec3 u_;
+  const Vec3 v_;
+  Vec3 n_;
+  Vec3 w_; // (u x v) / |u x v|^2, gives the edge coordinates of a point
+
+public:
+
+  Quad(const Material *const mat, const Vec3 &corner, const Vec3 &u, const Vec3 &v) :
+    Object(mat),
+    corner_(corner),
+    u_(u),
+    v_(v)
+  {
+    const Vec3 cross = u.cross(v);
+    n_ = cross.normalized();
+    w_ = cross / cross.squaredNorm();
+  }
+
+  virtual ~Quad() = default;
+
+  virtual real Intersect(const Ray &ray) const override
+  {
+    real dist = std::numeric_limits<real>::infinity();
+    const real cos_theta = ray.dir_.dot(n_);
+    if (cos_theta > -EPS_) return dist;
+    const real t = (corner_ - ray.ori_).dot(n_) / cos_theta;
+    if (t < 0) return dist;
+    const Vec3 p = ray.ori_ + ray.dir_ * t - corner_;
+    const real a = w_.dot(p.cross(v_));
+    const real b = w_.dot(u_.cross(p));
+    if (a < -EPS_ || a > 1 + EPS_ || b < -EPS_ || b > 1 + EPS_) return dist;
+    return t;
+  }
+
+  virtual Vec3 ClosestNormal(const Vec3 &/*pos*/) const override { return n_; }
+
+  // padded so that the box is never flat
+  virtual AABB Bounds() const override
+  {
+    AABB box;
+    box.Extend(corner_);
+    box.Extend(corner_ + u_);
+    box.Extend(corner_ + v_);
+    box.Extend(corner_ + u_ + v_);
+    box.min_ -= Vec3::Constant(EPS_);
+    box.max_ += Vec3::Constant(EPS_);
+    return box;
+  }
+
+  virtual ObjectRecord Record() const override
+  {
+    return {ObjectType::Quad, mat_id_, -1,
+            {corner_[0], corner_[1], corner_[2], u_[0], u_[1], u_[2], v_[0], v_[1], v_[2]}};
+  }
+};
+
+// one-sided like Quad, facing `dir`
+class Disk : public Object
+{
+protected:
+
+  const Vec3 cen_;
+  const Vec3 n_;
+  const real rad_;
+
+public:
+
+  Disk(const Material *const mat, const Vec3 &cen, const Vec3 &dir, const real rad) :
+    Object(mat),
+    cen_(cen),
+    n_(dir.normalized()),
+    rad_(rad)
+  { }
+
+  virtual ~Disk() = default;
+
+  const Vec3 &Center() const { return cen_; }
+  const Vec3 &Normal() const { return n_; }
+  real Radius() const { return rad_; }
+
+  virtual real Intersect(const Ray &ray) const override
+  {
+    real dist = std::numeric_limits<real>::infinity();
+    const real cos_theta = ray.dir_.dot(n_);
+    if (cos_theta > -EPS_) return dist;
+    const real t = (cen_ - ray.ori_).dot(n_) / cos_theta;
+    if (t < 0 || (ray.ori_ + ray.dir_ * t - cen_).squaredNorm() > rad_ * rad_) return dist;
+    return t;
+  }
+
+  virtual Vec3 ClosestNormal(const Vec3 &/*pos*/) const override { return n_; }
+
+  virtual AABB Bounds() const override
+  {
+    // extent of the rim along each axis
+    const Vec3 half = rad_ * (Vec3::Ones() - n_.cwiseAbs2()).cwiseMax(0).cwiseSqrt() + Vec3::Constant(EPS_);
+    return {cen_ - half, cen_ + half};
+  }
+
+  virtual ObjectRecord Record() const override
+  {
+    return {ObjectType::Disk, mat_id_, -1, {cen_[0], cen_[1], cen_[2], n_[0], n_[1], n_[2], rad_}};
+  }
 };
 
 class Sphere : public Object
@@ -70,6 +249,9 @@ public:
 
   virtual ~Sphere() = default;
 
+  const Vec3 &Center() const { return cen_; }
+  real Radius() const { return rad_; }
+
   virtual real Intersect(const Ray &ray) const override
   {
     real dist = std::numeric_limits<real>::infinity();
@@ -87,6 +269,13 @@ public:
   }
 
   virtual Vec3 ClosestNormal(const Vec3 &pos) const { return (pos - cen_).normalized(); }
+
+  virtual AABB Bounds() const override { return {cen_ - Vec3::Constant(rad_), cen_ + Vec3::Constant(rad_)}; }
+
+  virtual ObjectRecord Record() const override
+  {
+    return {ObjectType::Sphere, mat_id_, -1, {cen_[0], cen_[1], cen_[2], rad_}};
+  }
 };
 
 class CapeOutside: public Object{
@@ -122,6 +311,18 @@ public:
 
   virtual ~CapeOutside() = default;
 
+  virtual ObjectRecord Record() const override
+  {
+    return {ObjectType::CapeOutside, mat_id_, -1, {v_[0][0], v_[0][1], v_[0][2], rad_}};
+  }
+
+  virtual AABB Bounds() const override
+  {
+    AABB box;
+    for (const Vec3 &v : v_) box.Extend(v);
+    return box;
+  }
+
   bool SameSide(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& p) const {
     Vec3 ab = b - a;
     Vec3 ac = c - a;
@@ -192,6 +393,18 @@ public:
 
   virtual ~CapeInside() = default;
 
+  virtual ObjectRecord Record() const override
+  {
+    return {ObjectType::CapeInside, mat_id_, -1, {v_[0][0], v_[0][1], v_[0][2], rad_}};
+  }
+
+  virtual AABB Bounds() const override
+  {
+    AABB box;
+    for (const Vec3 &v : v_) box.Extend(v);
+    return box;
+  }
+
   bool SameSide(const Vec3& a, const Vec3& b, const Vec3& c, const Vec3& p) const {
     Vec3 ab = b - a;
     Vec3 ac = c - a;
@@ -260,6 +473,17 @@ public:
 
   virtual ~Cube() = default;
 
+  virtual AABB Bounds() const override
+  {
+    const Vec3 half(l_ / 2, h_ / 2, w_ / 2);
+    return {cen_ - half, cen_ + half};
+  }
+
+  virtual ObjectRecord Record() const override
+  {
+    return {ObjectType::Cube, mat_id_, -1, {cen_[0], cen_[1], cen_[2], l_, h_, w_}};
+  }
+
   virtual real Intersect(const Ray &ray) const override
   {
     real dist = std::numeric_limits<real>::infinity();
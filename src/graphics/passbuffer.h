@@ -0,0 +1,83 @@
+#pragma once
+
+#include <omp.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace VCL {
+
+// Records the threads of a pass append and that are read back after it,
+// without locks or allocations during the pass. Threads take blocks of
+// kBlock records with one atomic add and fill them alone. Room is made
+// between passes, by Reserve and by Drain, which doubles what the last pass
+// asked for if that did not fit; records beyond the room are dropped.
+template <class T>
+class PassBuffer
+{
+public:
+
+  static constexpr int kBlock = 64;
+
+  PassBuffer() : cursors_(omp_get_max_threads()) { }
+
+  // room for `records` appends; not thread safe
+  void Reserve(size_t records)
+  {
+    // every thread may leave a block partly filled
+    records += cursors_.size() * kBlock;
+    if (records_.size() < records) records_.resize(records);
+  }
+
+  // thread safe
+  void Push(const T &record)
+  {
+    Cursor &cursor = cursors_[omp_get_thread_num()];
+    if (cursor.next_ == cursor.end_) {
+      const size_t first = claimed_.fetch_add(kBlock, std::memory_order_relaxed);
+      if (first + kBlock > records_.size()) return;
+      cursor.next_ = first;
+      cursor.end_ = first + kBlock;
+    }
+    records_[cursor.next_++] = record;
+  }
+
+  // calls `f` for every record appended since the last call, then makes
+  // room for the next pass; not thread safe
+  template <class F>
+  void Drain(F f)
+  {
+    const size_t claimed = claimed_.load(std::memory_order_relaxed);
+    const size_t filled = std::min(claimed, records_.size() / kBlock * kBlock);
+    for (size_t block = 0; block < filled; block += kBlock) {
+      size_t end = block + kBlock;
+      for (const Cursor &cursor : cursors_)
+        if (cursor.end_ == end) end = cursor.next_; // the block a thread is still filling
+      for (size_t i = block; i < end; i++) f(records_[i]);
+    }
+    Clear();
+    if (claimed > filled) Reserve(2 * claimed);
+  }
+
+  // drops the records; not thread safe
+  void Clear()
+  {
+    claimed_.store(0, std::memory_order_relaxed);
+    for (Cursor &cursor : cursors_) cursor = Cursor();
+  }
+
+private:
+
+  // one cache line per thread
+  struct alignas(64) Cursor
+  {
+    size_t next_ = 0, end_ = 0;
+  };
+
+  std::vector<T> records_;
+  std::atomic<size_t> claimed_{0};
+  std::vector<Cursor> cursors_;
+};
+
+}
@@ -0,0 +1,96 @@
+#include "pathguide.h"
+
+#include "common/helperfunc.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace VCL {
+
+namespace {
+constexpr real kUniform = real(0.1); // keeps every bin reachable
+}
+
+Vec3 PathGuide::Cell::SampleDir() const
+{
+  const int bin = std::min(int(std::upper_bound(cdf_, cdf_ + kBins, float(rand01())) - cdf_), kBins - 1);
+  const real z = -1 + 2 * ((bin / kBinsPhi) + rand01()) / kBinsZ;
+  const real phi = -PI_ + 2 * PI_ * ((bin % kBinsPhi) + rand01()) / kBinsPhi;
+  const real r = std::sqrt(std::max(real(0), 1 - z * z));
+  return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+real PathGuide::Cell::Pdf(const Vec3 &dir) const
+{
+  return prob_[Bin(dir)] * kBins / (4 * PI_);
+}
+
+PathGuide::PathGuide(real cell, int min_samples) :
+  cell_(cell),
+  min_samples_(min_samples)
+{ }
+
+uint64_t PathGuide::Key(const Vec3 &pos) const
+{
+  const uint64_t mask = (1 << 21) - 1;
+  const Vec3 c = pos / cell_;
+  return ((uint64_t(int(std::floor(c[0]))) & mask) << 42) | ((uint64_t(int(std::floor(c[1]))) & mask) << 21) |
+         (uint64_t(int(std::floor(c[2]))) & mask);
+}
+
+int PathGuide::Bin(const Vec3 &dir)
+{
+  const int iz = std::clamp(int((dir[2] + 1) / 2 * kBinsZ), 0, kBinsZ - 1);
+  const int iphi = std::clamp(int((std::atan2(dir[1], dir[0]) + PI_) / (2 * PI_) * kBinsPhi), 0, kBinsPhi - 1);
+  return iz * kBinsPhi + iphi;
+}
+
+const PathGuide::Cell *PathGuide::Find(const Vec3 &pos) const
+{
+  const auto it = index_.find(Key(pos));
+  if (it == index_.end() || cells_[it->second].count_ < min_samples_) return nullptr;
+  return &cells_[it->second];
+}
+
+void PathGuide::Record(const Vec3 &pos, const Vec3 &dir, real radiance, real pdf)
+{
+  if (!(pdf > 0) || !std::isfinite(radiance)) return;
+  pending_.Push({Key(pos), Bin(dir), float(radiance / pdf)});
+}
+
+void PathGuide::Commit()
+{
+  std::vector<int> touched;
+  pending_.Drain([&](const Sample &s) {
+    const auto it = index_.emplace(s.key_, int(cells_.size()));
+    if (it.second) cells_.emplace_back();
+    Cell &cell = cells_[it.first->second];
+    cell.count_++;
+    cell.sum_[s.bin_] += s.value_;
+    touched.push_back(it.first->second);
+  });
+  std::sort(touched.begin(), touched.end());
+  touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+  // rebuild the distributions of every cell that got samples
+  for (const int i : touched) {
+    Cell &cell = cells_[i];
+    if (cell.count_ < min_samples_) continue;
+    float total = 0;
+    for (int b = 0; b < kBins; b++) total += cell.sum_[b];
+    float acc = 0;
+    for (int b = 0; b < kBins; b++) {
+      cell.prob_[b] = float((1 - kUniform) * (total > 0 ? cell.sum_[b] / total : real(1) / kBins) + kUniform / kBins);
+      acc += cell.prob_[b];
+      cell.cdf_[b] = acc;
+    }
+  }
+}
+
+void PathGuide::Clear()
+{
+  cells_.clear();
+  index_.clear();
+  pending_.Clear();
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "common/mathtype.h"
+#include "graphics/passbuffer.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace VCL {
+
+// Online path guiding: a world space grid whose cells learn a directional
+// histogram of incident radiance from the paths traced so far. Diffuse
+// bounces sample a mixture of the histogram and the cosine lobe.
+// The histogram covers the whole sphere in equal area bins (z = cos theta
+// times phi), so every bin has the same solid angle.
+// Cells are read only while a pass renders; paths record their samples in
+// a PassBuffer, and Commit merges them and rebuilds the distributions.
+class PathGuide
+{
+public:
+
+  static constexpr int kBinsZ = 16;
+  static constexpr int kBinsPhi = 16;
+  static constexpr int kBins = kBinsZ * kBinsPhi;
+  static constexpr real kGuideProb = real(0.5); // share of guided diffuse samples
+
+  struct Cell
+  {
+    float sum_[kBins] = {};  // radiance / pdf per bin, summed
+    float prob_[kBins] = {}; // normalized distribution over the bins
+    float cdf_[kBins] = {};
+    int count_ = 0;
+
+    Vec3 SampleDir() const;
+    real Pdf(const Vec3 &dir) const; // per solid angle
+  };
+
+  explicit PathGuide(real cell, int min_samples = 128);
+
+  // trained cell at `pos`, or nullptr
+  const Cell *Find(const Vec3 &pos) const;
+
+  // one incident radiance sample at `pos` from `dir`, taken with
+  // probability density `pdf`; thread safe
+  void Record(const Vec3 &pos, const Vec3 &dir, real radiance, real pdf);
+
+  // room for `samples` Record calls in the next pass, more are dropped;
+  // not thread safe
+  void Reserve(int samples) { pending_.Reserve(samples); }
+
+  // merges the samples recorded since the last call; not thread safe
+  void Commit();
+
+  void Clear();
+
+private:
+
+  struct Sample
+  {
+    uint64_t key_;
+    int bin_;
+    float value_;
+  };
+
+  uint64_t Key(const Vec3 &pos) const;
+  static int Bin(const Vec3 &dir);
+
+private:
+
+  const real cell_;
+  const int min_samples_;
+  std::vector<Cell> cells_;
+  std::unordered_map<uint64_t, int> index_;
+  PassBuffer<Sample> pending_;
+};
+
+}
@@ -0,0 +1,140 @@
+#include "photonmap.h"
+
+#include "common/alloccheck.h"
+#include "common/helperfunc.h"
+#include "graphics/globillum.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace VCL {
+
+namespace {
+constexpr int kMaxBounces = 8;
+
+// uniform direction on the unit sphere
+Vec3 SampleSphere()
+{
+  const real z = 1 - 2 * rand01();
+  const real phi = rand01() * 2 * PI_;
+  return GlobIllum::AxisAngle(z >= 0 ? Vec3::UnitY() : Vec3(-Vec3::UnitY()), z * z, phi);
+}
+}
+
+void PhotonMap::Reset()
+{
+  pass_ = 0;
+  radius2_ = radius0_ * radius0_;
+}
+
+void PhotonMap::Emit(const Scene &scene, int count)
+{
+  if (pass_ > 0) radius2_ *= (pass_ + alpha_) / (pass_ + 1);
+  pass_++;
+
+  // emitters are picked proportionally to their power
+  std::vector<real> areas;
+  std::vector<real> cdf;
+  real total = 0;
+  for (const Emitter &e : scene.emitters_) {
+    areas.push_back(PI_ * e.rad_ * e.rad_ * (e.n_.any() ? 1 : 4));
+    total += PI_ * e.radiance_.mean() * areas.back();
+    cdf.push_back(total);
+  }
+
+  // a photon can leave several caustic vertices behind on mixed materials
+  stored_.resize(size_t(count) * 2);
+  std::atomic<int> num_stored(0);
+  if (total > 0) {
+    # pragma omp parallel for schedule(dynamic, 1024)
+    for (int i = 0; i < count; ++i) {
+      AllocFree alloc_free;
+      const real u = rand01() * total;
+      int k = 0;
+      while (k + 1 < int(cdf.size()) && cdf[k] < u) k++;
+      const Emitter &e = scene.emitters_[k];
+      Vec3 n, start;
+      if (e.n_.any()) {
+        n = e.n_;
+        start = e.cen_ + e.rad_ * std::sqrt(rand01()) * GlobIllum::AxisAngle(n, 0, rand01() * 2 * PI_);
+      }
+      else {
+        n = SampleSphere();
+        start = e.cen_ + e.rad_ * n;
+      }
+
+      // Le * pi * area / (count * probability of the emitter)
+      const real prob = (PI_ * e.radiance_.mean() * areas[k]) / total;
+      Color power = e.radiance_ * (PI_ * areas[k] / (real(count) * prob));
+      Ray ray(start, GlobIllum::AxisAngle(n, rand01(), rand01() * 2 * PI_));
+      ray.ori_ += real(0.01) * ray.dir_;
+
+      for (int bounce = 0; bounce < kMaxBounces; bounce++) {
+        Vec3 pos, normal;
+        const Object *obj = scene.Intersect(ray, pos, normal);
+        if (!obj) break;
+        const CompiledMaterial &mat = scene.Mat(obj);
+        if (mat.type_ == MaterialType::Emissive) break;
+        // only caustics are stored, direct and indirect diffuse light is the
+        // path tracer's; stored before the lobe is picked so that mixed
+        // materials keep their full power whichever way the photon goes on
+        if (bounce > 0 && mat.k_d_.any()) {
+          const int slot = num_stored++;
+          if (slot < int(stored_.size())) stored_[slot] = {pos, normal, power};
+        }
+        Color weight;
+        bool diffuse;
+        const Vec3 d = GlobIllum::Sample(mat, normal, -ray.dir_, weight, &diffuse);
+        if (diffuse) break;
+        power *= weight;
+        if (!power.any()) break;
+        ray = Ray(pos + real(0.01) * d, d);
+      }
+    }
+    CheckAllocFree("a photon pass");
+  }
+  stored_.resize(std::min<size_t>(num_stored, stored_.size()));
+
+  // counting sort by grid bucket; cells are two radii wide so a query
+  // touches 2x2x2 cells
+  cell_ = 2 * std::sqrt(radius2_);
+  table_size_ = 1024;
+  while (table_size_ < stored_.size()) table_size_ *= 2;
+  const int n = int(stored_.size());
+  keys_.resize(n);
+  # pragma omp parallel for
+  for (int i = 0; i < n; ++i) {
+    const Vec3 c = stored_[i].pos_ / cell_;
+    keys_[i] = Bucket(int(std::floor(c[0])), int(std::floor(c[1])), int(std::floor(c[2])));
+  }
+  cell_start_.assign(table_size_ + 1, 0);
+  for (int i = 0; i < n; ++i) cell_start_[keys_[i] + 1]++;
+  for (uint32_t b = 0; b < table_size_; b++) cell_start_[b + 1] += cell_start_[b];
+  photons_.resize(n);
+  std::vector<int> cursor(cell_start_.begin(), cell_start_.end() - 1);
+  for (int i = 0; i < n; ++i) photons_[cursor[keys_[i]]++] = stored_[i];
+}
+
+Color PhotonMap::Estimate(const Vec3 &pos, const Vec3 &n) const
+{
+  Color sum(0, 0, 0);
+  if (photons_.empty()) return sum;
+  const Vec3 c = pos / cell_ - Vec3::Constant(0.5);
+  const int x = int(std::floor(c[0])), y = int(std::floor(c[1])), z = int(std::floor(c[2]));
+  uint32_t visited[8];
+  int num_visited = 0;
+  for (int k = 0; k < 8; k++) {
+    const uint32_t b = Bucket(x + (k & 1), y + ((k >> 1) & 1), z + (k >> 2));
+    // distinct cells may share a bucket, it must only be read once
+    if (std::find(visited, visited + num_visited, b) != visited + num_visited) continue;
+    visited[num_visited++] = b;
+    for (int i = cell_start_[b]; i < cell_start_[b + 1]; i++) {
+      const Photon &p = photons_[i];
+      if ((p.pos_ - pos).squaredNorm() < radius2_ && p.n_.dot(n) > 0) sum += p.power_;
+    }
+  }
+  return sum / (PI_ * radius2_);
+}
+
+}
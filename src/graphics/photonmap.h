@@ -0,0 +1,64 @@
+#pragma once
+
+#include "graphics/scene.h"
+
+#include <vector>
+
+namespace VCL {
+
+// Progressive caustic photon map. Every pass shoots a fresh set of photons
+// from the emissive spheres and keeps those reaching a diffuse surface after
+// at least one specular bounce (light - specular+ - diffuse paths). They are
+// stored sorted by the cell of a hashed uniform grid, so a density estimate
+// reads a few contiguous runs. The gather radius shrinks with every pass
+// (r^2 *= (i + alpha) / (i + 1)), which makes the average over passes
+// converge like progressive photon mapping.
+class PhotonMap
+{
+public:
+
+  struct Photon
+  {
+    Vec3 pos_;
+    Vec3 n_;      // surface normal, keeps photons from leaking through thin objects
+    Color power_;
+  };
+
+  explicit PhotonMap(real radius, real alpha = real(2) / 3) : radius0_(radius), alpha_(alpha) { Reset(); }
+
+  // restart the radius sequence, e.g. when the film is cleared
+  void Reset();
+
+  // emits `count` photons in parallel and rebuilds the grid; the map must
+  // not be queried while this runs
+  void Emit(const Scene &scene, int count);
+
+  // irradiance at `pos` on a surface with normal `n`
+  Color Estimate(const Vec3 &pos, const Vec3 &n) const;
+
+  int Size() const { return int(photons_.size()); }
+  real Radius() const { return std::sqrt(radius2_); }
+
+private:
+
+  uint32_t Bucket(int x, int y, int z) const
+  {
+    return (uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u) & (table_size_ - 1);
+  }
+
+private:
+
+  const real radius0_;
+  const real alpha_;
+  int pass_ = 0;
+  real radius2_;
+  real cell_ = 1;
+
+  std::vector<Photon> stored_;   // unsorted, filled by Emit
+  std::vector<Photon> photons_;  // sorted by bucket
+  std::vector<uint32_t> keys_;
+  std::vector<int> cell_start_;  // table_size_ + 1 offsets into photons_
+  uint32_t table_size_ = 0;
+};
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <csignal>
 #include <string>
 #include "graphics/image.h"
 #include "graphics/framebuffer.h"
@@ -7,7 +8,8 @@
 namespace VCL {
 class VWindow {
  public:
-  bool should_close_= false;
+  // set from signal handlers on headless platforms
+  volatile std::sig_atomic_t should_close_ = 0;
   Image* surface_ = nullptr;
   // keys
   // buttoms
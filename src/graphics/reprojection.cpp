@@ -0,0 +1,99 @@
+#include "reprojection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace VCL {
+
+int Reproject(Film &film, const Camera &from, const Camera &to, const Scene &scene, int max_history,
+              real clamp_sigma)
+{
+  const int width = film.width_;
+  const int height = film.height_;
+  const int size = width * height;
+  // the old accumulation, read while the film is rewritten
+  const std::vector<Color> color(film.color_, film.color_ + size);
+  const std::vector<int> cnt(film.cnt_, film.cnt_ + size);
+  const std::vector<Aov> aov(film.aov_, film.aov_ + size);
+
+  int kept = 0;
+#pragma omp parallel for schedule(dynamic, 4) reduction(+ : kept)
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const int i = y * width + x;
+      film.color_[i] = Color::Zero();
+      film.cnt_[i] = 0;
+      film.aov_[i] = Aov();
+      if (film.cost_) film.cost_[i] = Cost();
+
+      const Ray ray = to.GenerateRay((x + real(.5)) / width, (y + real(.5)) / height);
+      Vec3 pos, n;
+      const Object *obj = scene.Intersect(ray, pos, n);
+      if (!obj) continue;
+      const CompiledMaterial &mat = scene.Mat(obj);
+      film.aov_[i] = {mat.k_d_, n, (pos - ray.ori_).norm()};
+      // highlights and reflections move with the view
+      if (!mat.pure_diffuse_) continue;
+      real sx, sy;
+      if (!from.Project(pos, sx, sy)) continue;
+
+      // whether old pixel (ox, oy) saw the same surface
+      const real dist = (pos - from.pos_).norm();
+      auto matches = [&](int ox, int oy) {
+        if (ox < 0 || oy < 0 || ox >= width || oy >= height) return false;
+        const int j = oy * width + ox;
+        return cnt[j] > 0 && std::abs(aov[j].depth_ - dist) < real(0.05) * dist &&
+               aov[j].normal_.dot(n) > real(0.9) * aov[j].normal_.norm();
+      };
+
+      // bilinear over the matching ones of the four nearest old pixels
+      const real px = sx * width - real(.5);
+      const real py = sy * height - real(.5);
+      const int x0 = int(std::floor(px));
+      const int y0 = int(std::floor(py));
+      const real fx = px - x0;
+      const real fy = py - y0;
+      Color sum = Color::Zero();
+      real weight = 0;
+      int history = max_history;
+      for (int k = 0; k < 4; k++) {
+        const int ox = x0 + (k & 1);
+        const int oy = y0 + (k >> 1);
+        if (!matches(ox, oy)) continue;
+        const real w = (k & 1 ? fx : 1 - fx) * (k >> 1 ? fy : 1 - fy);
+        sum += w * color[oy * width + ox];
+        weight += w;
+        history = std::min(history, cnt[oy * width + ox]);
+      }
+      if (weight < real(0.25)) continue;  // mostly disoccluded
+      Color result = sum / weight;
+
+      // variance clipping against the matching 3x3 neighbourhood
+      Color m1 = Color::Zero(), m2 = Color::Zero();
+      int count = 0;
+      const int cx = int(std::floor(px + real(.5)));
+      const int cy = int(std::floor(py + real(.5)));
+      for (int oy = cy - 1; oy <= cy + 1; oy++) {
+        for (int ox = cx - 1; ox <= cx + 1; ox++) {
+          if (!matches(ox, oy)) continue;
+          const Color &c = color[oy * width + ox];
+          m1 += c;
+          m2 += c.cwiseProduct(c);
+          count++;
+        }
+      }
+      if (count > 1) {
+        const Color mean = m1 / count;
+        const Color sigma = (m2 / count - mean.cwiseProduct(mean)).cwiseMax(0).cwiseSqrt();
+        result = result.cwiseMax(mean - clamp_sigma * sigma).cwiseMin(mean + clamp_sigma * sigma);
+      }
+      film.color_[i] = result;
+      film.cnt_[i] = history;
+      kept++;
+    }
+  }
+  return kept;
+}
+
+};  // namespace VCL
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "graphics/camera.h"
+#include "graphics/film.h"
+#include "graphics/scene.h"
+
+namespace VCL {
+// Carries the accumulated samples of `film` over from the view `from` to the
+// view `to`. The film must have AOVs: their depth places every old pixel in
+// the scene. Each new pixel traces its center ray once, projects the hit into
+// the old view and blends the old pixels around it whose depth and normal
+// agree with the hit. Pixels without such a match (disocclusions, the image
+// border) and view-dependent surfaces start over. The result is clamped to
+// the mean +- clamp_sigma standard deviations of the matching old pixels in
+// a 3x3 window, which keeps edges from ghosting, and keeps at most
+// max_history samples so that new ones can still change it.
+// AOVs are rewritten for the new view, cost is cleared. Returns the number of
+// pixels that kept their history.
+int Reproject(Film &film, const Camera &from, const Camera &to, const Scene &scene, int max_history,
+              real clamp_sigma = real(1.25));
+};  // namespace VCL
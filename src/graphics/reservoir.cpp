@@ -0,0 +1,20 @@
+#include "reservoir.h"
+
+#include <algorithm>
+
+namespace VCL {
+
+ReservoirBuffer::ReservoirBuffer(int width, int height) :
+  width_(width),
+  height_(height),
+  prev_(size_t(width) * height),
+  next_(size_t(width) * height)
+{ }
+
+void ReservoirBuffer::Clear()
+{
+  std::fill(prev_.begin(), prev_.end(), Reservoir());
+  std::fill(next_.begin(), next_.end(), Reservoir());
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "common/mathtype.h"
+
+#include <vector>
+
+namespace VCL {
+
+// Weighted reservoir of light samples for resampled direct lighting
+// (GlobIllum::RESAMPLED_DIRECT): of all candidates streamed through Update,
+// one is kept with probability proportional to its weight.
+struct Reservoir
+{
+  int light_ = -1;             // index into Scene::lights_ or Scene::emitters_, -1 for none
+  Vec3 point_ = Vec3::Zero();  // on the light
+  real target_ = 0;            // target function of the kept sample at pos_
+  real w_sum_ = 0;
+  int m_ = 0;                  // candidates seen
+  Vec3 pos_ = Vec3::Zero();    // the shading point it was built for
+  Vec3 n_ = Vec3::Zero();
+
+  // `m` candidates represented by one sample of weight `w`
+  void Update(int light, const Vec3 &point, real w, real target, int m, real u)
+  {
+    w_sum_ += w;
+    m_ += m;
+    if (w > 0 && u * w_sum_ < w) {
+      light_ = light;
+      point_ = point;
+      target_ = target;
+    }
+  }
+
+  // contribution weight of the kept sample, the inverse of its effective pdf
+  real Weight() const { return target_ > 0 && m_ > 0 ? w_sum_ / (m_ * target_) : 0; }
+};
+
+// The reservoirs of the camera rays' first hits, one per pixel. A pass reads
+// those of the previous pass (the pixel itself and a few neighbours) and
+// writes its own, so threads never touch what others write; Swap between
+// passes. Reservoirs whose shading point does not match are not reused,
+// which keeps light from leaking across edges.
+class ReservoirBuffer
+{
+public:
+
+  static constexpr int kCandidates = 4;   // new light candidates per shading point
+  static constexpr int kNeighbours = 2;   // spatial reuse, from the previous pass
+  static constexpr int kRadius = 10;      // pixels
+  static constexpr int kMaxHistory = 20;  // reused reservoirs count at most this many candidates
+
+  ReservoirBuffer(int width, int height);
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+
+  const Reservoir &Previous(int x, int y) const { return prev_[y * width_ + x]; }
+  void Store(int x, int y, const Reservoir &r) { next_[y * width_ + x] = r; }
+
+  // what was stored becomes what is read; not thread safe
+  void Swap() { prev_.swap(next_); }
+  // forgets everything, e.g. after the view or the scene changed
+  void Clear();
+
+private:
+
+  int width_, height_;
+  std::vector<Reservoir> prev_, next_;
+};
+
+// the pixel whose camera ray the calling thread traces, set by the renderer
+// around the kernel call; with no buffer the first hit resamples without reuse
+struct ReservoirPixel
+{
+  ReservoirBuffer *buffer_ = nullptr;
+  int x_ = 0, y_ = 0;
+};
+
+inline thread_local ReservoirPixel g_reservoir_pixel;
+
+}
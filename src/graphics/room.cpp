@@ -0,0 +1,155 @@
+#include "room.h"
+
+#include "common/helperfunc.h"
+
+#include <cmath>
+#include <random>
+
+namespace VCL {
+void BuildRoom(Scene &scene, bool MonteCarlo, uint32_t seed) {
+  auto &mats = scene.mats_;
+	auto &objs = scene.objs_;
+  auto &lights = scene.lights_;
+  // a fixed seed gives the same layout every time
+  std::mt19937 rng(seed);
+  auto random = [&]() -> real { return seed ? std::uniform_real_distribution<real>()(rng) : rand_01(); };
+	// Initialize materials.
+	mats["ceiling"] = std::make_unique<Material>(Color(280, 10, 10)/255.0);
+	mats["floor"] = std::make_unique<Material>(Color(0,255,127)/255.0);
+	mats["front"] = std::make_unique<Material>(Color(0.3, 0.8, 0.8));
+  mats["end"] = std::make_unique<Material>(Color(0.8, 0.8, 0.3));
+	mats["side"] = std::make_unique<Material>(Color(0, 0.1, 1));//blue
+
+  if (MonteCarlo){
+    mats["mirror"] = std::make_unique<Material>(Color(37.2f, 24.4f, 13.2f) / 255, Color(.6f, .6f, .6f), -1);
+    mats["yellow_light"] = std::make_unique<Material>(Color(1, 1, 0.5), true);
+  }
+  else {
+    mats["mirror"] = std::make_unique<Material>(Color(0, 0, 0) , Color(1.6f, 1.6f, 1.6f), 30);
+    mats["yellow_light"] = std::make_unique<Material>(Color(10, 10, 5), true);
+  }
+	mats["light"] = std::make_unique<Material>(Color(20, 20, 20), true);
+  mats["small_light"] = std::make_unique<Material>(Color(3, 3, 3), true);
+ 
+
+  mats["metal"] = std::make_unique<Material>(Color(0, 0, 0), Color(.8f, .8f, .8f), 30);
+  if (MonteCarlo)
+    mats["lampo"] = std::make_unique<Material>(Color(0.8, 0.8, 0));
+  else
+    mats["lampo"] = std::make_unique<Material>(Color(1.8, 1.8, 0));
+  mats["lampi"] = std::make_unique<Material>(Color(0.1, 0.1, 0));
+  mats["stick"] = std::make_unique<Material>(Color(1.8, 1.8, 0.1));
+  mats["cube"] = std::make_unique<Material>(Color(0, 0, 0.5),Color(.01f, .01f, .01f), 0);
+
+  // Set boundaries: a 4 x 3 x 4 room, every wall facing inwards. The end
+  // wall faces away from the camera, which looks in through it.
+  objs.emplace_back(std::make_unique<Quad>(
+    mats["ceiling"].get(),
+    Vec3(-2, 3, -4), Vec3(4, 0, 0), Vec3(0, 0, 4)));
+  objs.emplace_back(std::make_unique<Quad>(
+    mats["floor"].get(),
+    Vec3(-2, 0, -4), Vec3(0, 0, 4), Vec3(4, 0, 0)));
+  objs.emplace_back(std::make_unique<Quad>(
+    mats["front"].get(),
+    Vec3(-2, 0, -4), Vec3(4, 0, 0), Vec3(0, 3, 0)));
+  objs.emplace_back(std::make_unique<Quad>(
+    mats["end"].get(),
+    Vec3(-2, 0, 0), Vec3(0, 3, 0), Vec3(4, 0, 0)));
+  objs.emplace_back(std::make_unique<Quad>(//left
+    mats["side"].get(),
+    Vec3(-2, 0, -4), Vec3(0, 3, 0), Vec3(0, 0, 4)));
+  objs.emplace_back(std::make_unique<Quad>(//right
+    mats["mirror"].get(),
+    Vec3(2, 0, -4), Vec3(0, 0, 4), Vec3(0, 3, 0)));
+ 
+	// Set the light.
+  //---random---
+  Vec3 dotlight1 = Vec3(0.8+0.2*random() ,1.6+0.2*random(),-4);
+  Vec3 dotlight2 = Vec3(-dotlight1[0], dotlight1[1],dotlight1[2]);
+  //---random---
+  // the ceiling light and the two small lights are disks just off their
+  // wall, with a point light in the middle
+  const real dl = real(2) / 3;
+  const real dl2 = 0.02;
+  const Vec3 ceiling_light(0, 3 - real(1e-3), -2);
+  dotlight1[2] += real(1e-3);
+  dotlight2[2] += real(1e-3);
+
+  objs.emplace_back(std::make_unique<Disk>( mats["light"].get(), ceiling_light, Vec3(0, -1, 0), dl));
+  lights.emplace_back(std::make_unique<Light>(ceiling_light, Color(1, 1, 1) * 2.0));
+  
+  objs.emplace_back(std::make_unique<Disk>( mats["small_light"].get(), dotlight1, Vec3(0, 0, 1), dl2));
+  lights.emplace_back(std::make_unique<Light>(dotlight1, Color(1, 1, 1) * 2.0));
+  
+  objs.emplace_back(std::make_unique<Disk>( mats["small_light"].get(), dotlight2, Vec3(0, 0, 1), dl2));
+  lights.emplace_back(std::make_unique<Light>(dotlight2, Color(1, 1, 1) * 2.0));
+  
+  // Set internal objects.
+  //---random---
+  real tmpz = random();
+  real ball_rad = 0.4 + 0.2 * random();
+  Vec3 ball ;
+  Vec3 cube_;
+
+  if(tmpz < 0.33){
+    ball = Vec3(0, ball_rad, -3);
+    cube_ = Vec3(-1, real(0.8), -1);
+  }
+  else if (tmpz < 0.67){
+    ball = Vec3(0, ball_rad, -1.2);
+    cube_ = Vec3(-0.2, real(0.8), -3);
+  }
+  else{
+    ball = Vec3(1.35, ball_rad, -2.5);
+    cube_ = Vec3(-1, real(0.8), -2);
+  }
+  //std::cout<<tmpz<<std::endl;
+  //std::cout<<ball_rad<<std::endl;
+  //---random---
+
+  // the cube and the ball are instances so that they can be animated
+  auto &cube_proto = scene.protos_["cube"];
+  cube_proto = std::make_unique<Prototype>();
+  cube_proto->objs_.emplace_back(std::make_unique<Cube>(mats["cube"].get(), Vec3(0, 0, 0), real(.6),real(1.6),real(.8)));
+  auto &ball_proto = scene.protos_["ball"];
+  ball_proto = std::make_unique<Prototype>();
+  ball_proto->objs_.emplace_back(std::make_unique<Sphere>( mats["metal"].get(), Vec3(0, 0, 0), ball_rad));
+
+  auto cube_inst = std::make_unique<Instance>(cube_proto.get(), Affine3(Eigen::Translation<real, 3>(cube_)));
+  auto ball_inst = std::make_unique<Instance>(ball_proto.get(), Affine3(Eigen::Translation<real, 3>(ball)));
+  // turntable of the cube and a bounce of the ball, two seconds each
+  const Quat quarter(Eigen::AngleAxis<real>(0.5f * PI_, Vec3::UnitY()));
+  scene.tracks_.emplace_back(cube_inst.get(), std::vector<Keyframe>{
+    {0, cube_}, {1, cube_, quarter}, {2, cube_, Quat(Eigen::AngleAxis<real>(PI_, Vec3::UnitY()))}});
+  scene.tracks_.emplace_back(ball_inst.get(), std::vector<Keyframe>{
+    {0, ball}, {1, ball + Vec3(0, 0.8, 0)}, {2, ball}});
+  objs.emplace_back(std::move(cube_inst));
+  objs.emplace_back(std::move(ball_inst));
+
+  // lamp position
+  //---random---
+  Vec3 lamp_o = Vec3(1.35+0.05*random(), real(1.5), -1.2-0.1*random());
+  //---random---
+
+  // the lamp is a prototype in its own space, origin at the top of the shade
+  auto &lamp = scene.protos_["lamp"];
+  lamp = std::make_unique<Prototype>();
+  auto &parts = lamp->objs_;
+  parts.emplace_back(std::make_unique<CapeOutside>(mats["lampo"].get(), Vec3(0, 0, 0), real(.5)));
+  parts.emplace_back(std::make_unique<CapeInside>(mats["lampi"].get(), Vec3(0, -0.01, 0), real(.5)));
+  parts.emplace_back(std::make_unique<Sphere>( mats["yellow_light"].get(), Vec3(0, -0.25, 0), real(.15)));
+  parts.emplace_back(std::make_unique<Cube>( mats["stick"].get(), Vec3(0, 0.58 - 1.5, 0), real(0.05),real(1.06),real(0.05)));
+  parts.emplace_back(std::make_unique<Cube>( mats["stick"].get(), Vec3(0, 0.025 - 1.5, 0), real(0.4),real(0.05),real(0.4)));
+
+  objs.emplace_back(std::make_unique<Instance>(lamp.get(), Affine3(Eigen::Translation<real, 3>(lamp_o))));
+  lights.emplace_back(std::make_unique<Light>( lamp_o + Vec3(0, -0.25, 0), Color(1, 1, 0) * 0.35));
+
+  scene.ambient_light_ = Color(0.05, 0.05, 0.05);
+}
+
+void RoomView(Camera &camera, float aspect) {
+  const float c_y = 1.5;
+  const float c_z = 1.5 + 1.5 * std::sqrt(2);
+  camera.InitData(aspect, 0.25f * PI_, 1.0f, 1000.0f, c_z, 0.0f, 0.5f * PI_, Vec3f(0, c_y, 0));
+}
+};  // namespace VCL
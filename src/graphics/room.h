@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+#include "graphics/camera.h"
+#include "graphics/scene.h"
+
+namespace VCL {
+// Fills an empty scene with the project's room: walls, ceiling and wall
+// lights, the cube, the ball and the lamp, with materials for either
+// integrator. Seed 0 draws a new random layout, any other seed always gives
+// the same one. Call Scene::Compile afterwards.
+void BuildRoom(Scene &scene, bool MonteCarlo, uint32_t seed = 0);
+
+// bump whenever BuildRoom changes what it builds; part of the SceneCache key
+constexpr uint32_t kRoomVersion = 1;
+
+// the view into the room through its open end
+void RoomView(Camera &camera, float aspect);
+};  // namespace VCL
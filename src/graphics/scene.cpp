@@ -1,24 +1,107 @@
 #include "scene.h"
+#include "cost.h"
+#include "touchmap.h"
+#include <cmath>
 #include <iostream>
+#include <unordered_map>
 namespace VCL {
 
-Object *Scene::Intersect(const Ray &ray, Vec3 &pos) const
+void Scene::Compile(bool build_bvhs)
 {
-  Object *collider = nullptr;
-  real dist = std::numeric_limits<real>::infinity();
+  std::unordered_map<const Material *, int> ids;
+  mat_table_.clear();
+  for (const auto &mat : mats_) {
+    ids[mat.second.get()] = int(mat_table_.size());
+    mat_table_.push_back(CompiledMaterial::Compile(*mat.second));
+  }
+  for (const auto &proto : protos_) {
+    for (const auto &object : proto.second->objs_) object->mat_id_ = ids.at(object->Mat());
+    if (build_bvhs) proto.second->Build();
+  }
+
+  std::vector<const Object *> objs;
   for (const auto &object : objs_) {
-    const real temp = object->Intersect(ray);
-    if (temp < dist) {
-      const Vec3 pos_t = ray.ori_ + ray.dir_ * temp;
-      if (((POSMIN_ - pos_t).array() <= EPS_).all() && ((pos_t - POSMAX_).array() <= EPS_).all()) {
-        dist = temp;
-        pos = pos_t;
-        collider = object.get();
+    object->id_ = int(objs.size());
+    objs.push_back(object.get());
+    if (object->Mat()) object->mat_id_ = ids.at(object->Mat()); // instances have no material
+  }
+  CollectEmitters();
+  if (build_bvhs) bvh_.Build(objs);
+}
+
+int Scene::MaterialId(const Material *mat) const
+{
+  int id = 0;
+  for (const auto &entry : mats_) { // the order Compile flattens them in
+    if (entry.second.get() == mat) return id;
+    id++;
+  }
+  return -1;
+}
+
+void Scene::Animate(real time)
+{
+  if (tracks_.empty()) return;
+  for (const Track &track : tracks_) track.target_->SetTransform(track.Evaluate(time));
+  CollectEmitters();
+  bvh_.Refit();
+}
+
+void Scene::CollectEmitters()
+{
+  emitters_.clear();
+  for (const auto &object : objs_) {
+    if (const auto *instance = dynamic_cast<const Instance *>(object.get())) {
+      // assumes instances holding emitters are not sheared
+      const Affine3 &xf = instance->Transform();
+      const real scale = std::cbrt(std::abs(xf.linear().determinant()));
+      for (const auto &member : instance->Proto()->objs_) {
+        if (!member->Mat()->emissive_) continue;
+        const Color &radiance = member->Mat()->k_d_;
+        if (const auto *sphere = dynamic_cast<const Sphere *>(member.get()))
+          emitters_.push_back({xf * sphere->Center(), sphere->Radius() * scale, radiance, member.get(), object.get()});
+        if (const auto *disk = dynamic_cast<const Disk *>(member.get()))
+          emitters_.push_back({xf * disk->Center(), disk->Radius() * scale, radiance, member.get(), object.get(),
+                               (xf.linear() * disk->Normal()).normalized()});
       }
+      continue;
     }
+    if (!object->Mat()->emissive_) continue;
+    const Color &radiance = object->Mat()->k_d_;
+    if (const auto *sphere = dynamic_cast<const Sphere *>(object.get()))
+      emitters_.push_back({sphere->Center(), sphere->Radius(), radiance, object.get(), object.get()});
+    if (const auto *disk = dynamic_cast<const Disk *>(object.get()))
+      emitters_.push_back({disk->Center(), disk->Radius(), radiance, object.get(), object.get(), disk->Normal()});
   }
-  pos = pos.cwiseMax(POSMIN_).cwiseMin(POSMAX_);
-  return collider;
 }
 
-}
\ No newline at end of file
+bool Scene::Intersect(const Ray &ray, Hit &hit) const
+{
+  bool found = false;
+  Cost *cost = g_cost;
+  bvh_.Traverse(ray, hit.t_, [&](const Object *object) {
+    if (cost) cost->tests_++;
+    found |= object->Intersect(ray, hit);
+  });
+  if (g_touch.bits_) g_touch.map_->RecordRay(g_touch.bits_, ray, found ? &hit : nullptr, g_touch.space_);
+  return found;
+}
+
+const Object *Scene::Intersect(const Ray &ray, Vec3 &pos, Vec3 &n) const
+{
+  Hit hit;
+  if (!Intersect(ray, hit)) return nullptr;
+  pos = ray.ori_ + ray.dir_ * hit.t_;
+  n = hit.top_->HitNormal(hit);
+  return hit.obj_;
+}
+
+const Object *Scene::Intersect(const Ray &ray, Vec3 &pos) const
+{
+  Hit hit;
+  if (!Intersect(ray, hit)) return nullptr;
+  pos = ray.ori_ + ray.dir_ * hit.t_;
+  return hit.obj_;
+}
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 
-#include "graphics/object.h"
+#include "graphics/animation.h"
+#include "graphics/instance.h"
 #include "graphics/light.h"
 
 #include <map>
@@ -9,21 +10,75 @@
 
 namespace VCL {
 
+class IrradianceCache;
+class PathGuide;
+class PhotonMap;
+
+// emissive sphere or disk, sampled directly for next event estimation
+struct Emitter
+{
+  Vec3 cen_;
+  real rad_;
+  Color radiance_;
+  const Object *obj_; // the primitive, shared by all instances of its prototype
+  const Object *top_; // the primitive itself or its instance
+  Vec3 n_ = Vec3::Zero(); // facing direction of a disk, zero for spheres
+};
+
 class Scene
 {
 public:
 
   Color ambient_light_;
   std::vector<std::unique_ptr<Object>> objs_;
+  std::map<std::string, std::unique_ptr<Prototype>> protos_; // referenced by Instance objects in objs_
   std::map<std::string, std::unique_ptr<Material>> mats_;
   std::vector<std::unique_ptr<Light>> lights_;
+  std::vector<CompiledMaterial> mat_table_; // built by Compile
+  std::vector<Emitter> emitters_; // built by Compile, emissive spheres and disks only
+  std::vector<Track> tracks_; // keyframed instances, applied by Animate
+  const PhotonMap *caustics_ = nullptr; // owned by the renderer, for GlobIllum::CAUSTICS
+  IrradianceCache *irradiance_ = nullptr; // owned by the renderer, for GlobIllum::IRRADIANCE_CACHE
+  PathGuide *guide_ = nullptr; // owned by the renderer, for GlobIllum::GUIDING
+  std::shared_ptr<void> cache_; // mapped SceneCache file the BVH nodes live in, if loaded from one
 
 public:
 
   Scene() = default;
   virtual ~Scene() = default;
 
-  Object *Intersect(const Ray &ray, Vec3 &pos) const;
+  // flattens mats_ into mat_table_ and links the objects to it, then
+  // builds the prototype and scene BVHs; call after the scene is built,
+  // after every material edit and after objects are added or moved.
+  // `build_bvhs` is false when SceneCache has already adopted them
+  void Compile(bool build_bvhs = true);
+
+  // moves the tracked instances to `time` (seconds) and refits the scene
+  // BVH; cheap enough to call between frames, nothing is reallocated
+  void Animate(real time);
+
+  const CompiledMaterial &Mat(const Object *obj) const { return mat_table_[obj->MatId()]; }
+  // index of `mat` in mat_table_ as of the last Compile, -1 if it is not in mats_
+  int MaterialId(const Material *mat) const;
+
+  // closest hit; hit.obj_ is the primitive, also when it belongs to an
+  // instance
+  bool Intersect(const Ray &ray, Hit &hit) const;
+
+  // returns the primitive hit, its world position and normal
+  const Object *Intersect(const Ray &ray, Vec3 &pos, Vec3 &n) const;
+  const Object *Intersect(const Ray &ray, Vec3 &pos) const;
+
+  BVH &Bvh() { return bvh_; }
+  const BVH &Bvh() const { return bvh_; }
+
+private:
+
+  void CollectEmitters();
+
+private:
+
+  BVH bvh_;
 };
 
 }
@@ -0,0 +1,477 @@
+#include "scenecache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace VCL {
+namespace SceneCache {
+
+namespace {
+constexpr char kMagic[4] = {'V', 'C', 'L', 'S'};
+constexpr uint32_t kVersion = 3;
+constexpr size_t kAlign = 16;
+
+// `count_` items starting `offset_` bytes into the file
+struct Span
+{
+  uint64_t offset_ = 0;
+  uint64_t count_ = 0;
+};
+
+// nodes, then the object indices of the leaves and of the unbounded objects,
+// relative to the owner (a prototype or the scene)
+struct BvhRecord
+{
+  Span nodes_;
+  Span prims_;
+  Span unbounded_;
+};
+
+struct MaterialRecord
+{
+  char name_[32];
+  float k_d_[3];
+  float k_s_[3];
+  float alpha_;
+  uint32_t emissive_;
+};
+
+struct LightRecord
+{
+  float position_[3];
+  float intensity_[3];
+};
+
+struct ProtoRecord
+{
+  char name_[32];
+  uint32_t first_; // members are objects [first_, first_ + count_)
+  uint32_t count_;
+  BvhRecord bvh_;
+};
+
+struct TrackRecord
+{
+  uint32_t target_; // scene object index
+  uint32_t first_;  // keys [first_, first_ + count_)
+  uint32_t count_;
+};
+
+struct KeyRecord
+{
+  float time_;
+  float translation_[3];
+  float rotation_[4]; // x y z w
+  float scale_;
+};
+
+// everything after the header is hashed: the BVH arrays, then the
+// description (materials up to keys) they were built from
+struct Header
+{
+  char magic_[4];
+  uint32_t version_;
+  uint32_t node_size_;   // sizeof(BVH::Node), catches layout changes
+  uint32_t record_size_; // sizeof(ObjectRecord)
+  uint64_t source_;
+  uint64_t hash_;
+  uint64_t size_;
+  Span hashed_; // byte range covered by hash_
+  float ambient_[3];
+  uint32_t num_protos_objs_; // objs_ holds the prototype members first
+  Span mats_, lights_, protos_, objs_, tracks_, keys_;
+  BvhRecord bvh_;
+};
+
+class Writer
+{
+public:
+
+  std::vector<unsigned char> data_ = std::vector<unsigned char>(sizeof(Header));
+
+  template <class T>
+  Span Put(const T *items, size_t count)
+  {
+    data_.resize((data_.size() + kAlign - 1) / kAlign * kAlign);
+    Span span{data_.size(), count};
+    const auto *bytes = reinterpret_cast<const unsigned char *>(items);
+    data_.insert(data_.end(), bytes, bytes + count * sizeof(T));
+    return span;
+  }
+
+  template <class T>
+  Span Put(const std::vector<T> &items) { return Put(items.data(), items.size()); }
+
+  BvhRecord Put(const BVH &bvh, const std::unordered_map<const Object *, uint32_t> &index)
+  {
+    std::vector<uint32_t> prims, unbounded;
+    for (const Object *obj : bvh.Prims()) prims.push_back(index.at(obj));
+    for (const Object *obj : bvh.Unbounded()) unbounded.push_back(index.at(obj));
+    BvhRecord record;
+    record.nodes_ = Put(bvh.Nodes(), bvh.NumNodes());
+    record.prims_ = Put(prims);
+    record.unbounded_ = Put(unbounded);
+    return record;
+  }
+};
+
+bool CopyName(const std::string &name, char (&dst)[32])
+{
+  if (name.size() >= sizeof(dst)) return false;
+  std::memset(dst, 0, sizeof(dst));
+  std::memcpy(dst, name.data(), name.size());
+  return true;
+}
+
+// whole file, writable copy on write so that refits of adopted BVHs work
+std::shared_ptr<void> Map(const std::string &path, size_t &size)
+{
+#ifndef _WIN32
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(Header))) {
+    close(fd);
+    return nullptr;
+  }
+  size = size_t(st.st_size);
+  void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return nullptr;
+  return std::shared_ptr<void>(data, [size](void *p) { munmap(p, size); });
+#else
+  // no mmap here, read it into one buffer instead
+  std::FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f) return nullptr;
+  std::fseek(f, 0, SEEK_END);
+  const long length = std::ftell(f);
+  std::fseek(f, 0, SEEK_SET);
+  if (length < long(sizeof(Header))) {
+    std::fclose(f);
+    return nullptr;
+  }
+  size = size_t(length);
+  std::shared_ptr<void> data(new unsigned char[size], [](void *p) { delete[] static_cast<unsigned char *>(p); });
+  const bool ok = std::fread(data.get(), 1, size, f) == size;
+  std::fclose(f);
+  return ok ? data : nullptr;
+#endif
+}
+
+std::unique_ptr<Object> MakeObject(const ObjectRecord &r, const std::vector<const Material *> &mats,
+                                   const std::vector<const Prototype *> &protos)
+{
+  const float *p = r.p_;
+  if (r.type_ == ObjectType::Instance) {
+    if (r.proto_ < 0 || r.proto_ >= int(protos.size())) return nullptr;
+    Affine3 xf;
+    xf.matrix().setIdentity();
+    xf.affine() = Eigen::Map<const Eigen::Matrix<float, 3, 4>>(p);
+    return std::make_unique<Instance>(protos[r.proto_], xf);
+  }
+  if (r.mat_ < 0 || r.mat_ >= int(mats.size())) return nullptr;
+  const Material *mat = mats[r.mat_];
+  switch (r.type_) {
+  case ObjectType::Plane: return std::make_unique<Plane>(mat, Vec3(p[0], p[1], p[2]), Vec3(p[3], p[4], p[5]));
+  case ObjectType::Sphere: return std::make_unique<Sphere>(mat, Vec3(p[0], p[1], p[2]), p[3]);
+  case ObjectType::CapeOutside: return std::make_unique<CapeOutside>(mat, Vec3(p[0], p[1], p[2]), p[3]);
+  case ObjectType::CapeInside: return std::make_unique<CapeInside>(mat, Vec3(p[0], p[1], p[2]), p[3]);
+  case ObjectType::Cube: return std::make_unique<Cube>(mat, Vec3(p[0], p[1], p[2]), p[3], p[4], p[5]);
+  case ObjectType::Quad:
+    return std::make_unique<Quad>(mat, Vec3(p[0], p[1], p[2]), Vec3(p[3], p[4], p[5]), Vec3(p[6], p[7], p[8]));
+  case ObjectType::Disk: return std::make_unique<Disk>(mat, Vec3(p[0], p[1], p[2]), Vec3(p[3], p[4], p[5]), p[6]);
+  default: return nullptr;
+  }
+}
+}
+
+uint64_t Hash(const void *data, size_t size, uint64_t seed)
+{
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+  return hash;
+}
+
+bool Save(const Scene &scene, const std::string &path, uint64_t source)
+{
+  Writer w;
+  Header h = {};
+  std::memcpy(h.magic_, kMagic, sizeof(kMagic));
+  h.version_ = kVersion;
+  h.node_size_ = sizeof(BVH::Node);
+  h.record_size_ = sizeof(ObjectRecord);
+  h.source_ = source;
+  for (int k = 0; k < 3; k++) h.ambient_[k] = scene.ambient_light_[k];
+
+  // objects and prototypes are numbered in storage order
+  std::vector<ObjectRecord> objs;
+  std::vector<ProtoRecord> protos;
+  std::unordered_map<const Prototype *, int> proto_ids;
+  for (const auto &proto : scene.protos_) {
+    ProtoRecord record = {};
+    if (!CopyName(proto.first, record.name_)) return false;
+    record.first_ = uint32_t(objs.size());
+    record.count_ = uint32_t(proto.second->objs_.size());
+    std::unordered_map<const Object *, uint32_t> index;
+    for (const auto &object : proto.second->objs_) {
+      if (dynamic_cast<const Instance *>(object.get())) return false; // instances do not nest
+      index[object.get()] = uint32_t(index.size());
+      objs.push_back(object->Record());
+    }
+    record.bvh_ = w.Put(proto.second->Bvh(), index);
+    proto_ids[proto.second.get()] = int(protos.size());
+    protos.push_back(record);
+  }
+  h.num_protos_objs_ = uint32_t(objs.size());
+  std::unordered_map<const Object *, uint32_t> index;
+  for (const auto &object : scene.objs_) {
+    index[object.get()] = uint32_t(index.size());
+    objs.push_back(object->Record());
+    if (const auto *instance = dynamic_cast<const Instance *>(object.get()))
+      objs.back().proto_ = proto_ids.at(instance->Proto());
+  }
+  h.bvh_ = w.Put(scene.Bvh(), index);
+
+  std::vector<MaterialRecord> mats;
+  for (const auto &mat : scene.mats_) {
+    MaterialRecord record = {};
+    if (!CopyName(mat.first, record.name_)) return false;
+    for (int k = 0; k < 3; k++) {
+      record.k_d_[k] = mat.second->k_d_[k];
+      record.k_s_[k] = mat.second->k_s_[k];
+    }
+    record.alpha_ = mat.second->alpha_;
+    record.emissive_ = mat.second->emissive_;
+    mats.push_back(record);
+  }
+  std::vector<LightRecord> lights;
+  for (const auto &light : scene.lights_) {
+    LightRecord record;
+    for (int k = 0; k < 3; k++) {
+      record.position_[k] = light->position[k];
+      record.intensity_[k] = light->intensity[k];
+    }
+    lights.push_back(record);
+  }
+  std::vector<TrackRecord> tracks;
+  std::vector<KeyRecord> keys;
+  for (const Track &track : scene.tracks_) {
+    tracks.push_back({index.at(track.target_), uint32_t(keys.size()), uint32_t(track.keys_.size())});
+    for (const Keyframe &key : track.keys_) {
+      const Quat &q = key.rotation_;
+      keys.push_back({key.time_, {key.translation_[0], key.translation_[1], key.translation_[2]},
+                      {q.x(), q.y(), q.z(), q.w()}, key.scale_});
+    }
+  }
+
+  h.mats_ = w.Put(mats);
+  h.lights_ = w.Put(lights);
+  h.protos_ = w.Put(protos);
+  h.objs_ = w.Put(objs);
+  h.tracks_ = w.Put(tracks);
+  h.keys_ = w.Put(keys);
+  const size_t begin = (sizeof(Header) + kAlign - 1) / kAlign * kAlign;
+  h.hashed_ = {begin, w.data_.size() - begin};
+  h.size_ = w.data_.size();
+  h.hash_ = Hash(&w.data_[begin], h.hashed_.count_, Hash(h.ambient_, sizeof(h.ambient_)));
+  std::memcpy(w.data_.data(), &h, sizeof(h));
+
+  // written next to the target and moved over it, readers never see half a file
+  const std::string tmp = path + ".tmp";
+  std::FILE *f = std::fopen(tmp.c_str(), "wb");
+  if (!f) return false;
+  const bool ok = std::fwrite(w.data_.data(), 1, w.data_.size(), f) == w.data_.size();
+  if (std::fclose(f) != 0 || !ok) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+#ifdef _WIN32
+  std::remove(path.c_str()); // rename does not replace files here
+#endif
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool Load(Scene &scene, const std::string &path, uint64_t source)
+{
+  size_t size = 0;
+  std::shared_ptr<void> data = Map(path, size);
+  if (!data) return false;
+  auto *base = static_cast<unsigned char *>(data.get());
+  const Header &h = *reinterpret_cast<const Header *>(base);
+  if (std::memcmp(h.magic_, kMagic, sizeof(kMagic)) != 0 || h.version_ != kVersion ||
+      h.node_size_ != sizeof(BVH::Node) || h.record_size_ != sizeof(ObjectRecord) || h.source_ != source ||
+      h.size_ != size)
+    return false;
+
+  auto fits = [size](const Span &span, size_t item) {
+    return span.offset_ <= size && span.count_ <= (size - span.offset_) / item;
+  };
+  auto fits_bvh = [&](const BvhRecord &b) {
+    return fits(b.nodes_, sizeof(BVH::Node)) && fits(b.prims_, sizeof(uint32_t)) && fits(b.unbounded_, sizeof(uint32_t));
+  };
+  if (!fits(h.hashed_, 1) || !fits(h.mats_, sizeof(MaterialRecord)) || !fits(h.lights_, sizeof(LightRecord)) ||
+      !fits(h.protos_, sizeof(ProtoRecord)) || !fits(h.objs_, sizeof(ObjectRecord)) ||
+      !fits(h.tracks_, sizeof(TrackRecord)) || !fits(h.keys_, sizeof(KeyRecord)) || !fits_bvh(h.bvh_) ||
+      h.num_protos_objs_ > h.objs_.count_)
+    return false;
+  if (Hash(base + h.hashed_.offset_, h.hashed_.count_, Hash(h.ambient_, sizeof(h.ambient_))) != h.hash_)
+    return false;
+
+  auto at = [base](const Span &span) { return base + span.offset_; };
+  const auto *mats = reinterpret_cast<const MaterialRecord *>(at(h.mats_));
+  const auto *lights = reinterpret_cast<const LightRecord *>(at(h.lights_));
+  const auto *protos = reinterpret_cast<const ProtoRecord *>(at(h.protos_));
+  const auto *objs = reinterpret_cast<const ObjectRecord *>(at(h.objs_));
+  const auto *tracks = reinterpret_cast<const TrackRecord *>(at(h.tracks_));
+  const auto *keys = reinterpret_cast<const KeyRecord *>(at(h.keys_));
+
+  auto fail = [&scene]() {
+    scene.objs_.clear();
+    scene.protos_.clear();
+    scene.mats_.clear();
+    scene.lights_.clear();
+    scene.tracks_.clear();
+    return false;
+  };
+  // checks the node links and object indices, then uses the nodes in place
+  auto adopt = [&](BVH &bvh, const BvhRecord &b, const std::vector<std::unique_ptr<Object>> &owner) {
+    auto *nodes = reinterpret_cast<BVH::Node *>(at(b.nodes_));
+    const int num_nodes = int(b.nodes_.count_);
+    for (int i = 0; i < num_nodes; i++) {
+      const BVH::Node &node = nodes[i];
+      if (node.count_ > 0 ? node.first_ < 0 || uint64_t(node.first_) + node.count_ > b.prims_.count_
+                          : node.count_ < 0 || node.first_ <= i + 1 || node.first_ >= num_nodes)
+        return false;
+    }
+    std::vector<const Object *> prims, unbounded;
+    const auto *prim_ids = reinterpret_cast<const uint32_t *>(at(b.prims_));
+    const auto *unbounded_ids = reinterpret_cast<const uint32_t *>(at(b.unbounded_));
+    for (uint64_t i = 0; i < b.prims_.count_; i++) {
+      if (prim_ids[i] >= owner.size()) return false;
+      prims.push_back(owner[prim_ids[i]].get());
+    }
+    for (uint64_t i = 0; i < b.unbounded_.count_; i++) {
+      if (unbounded_ids[i] >= owner.size()) return false;
+      unbounded.push_back(owner[unbounded_ids[i]].get());
+    }
+    bvh.Adopt(nodes, num_nodes, std::move(prims), std::move(unbounded));
+    return true;
+  };
+
+  scene.ambient_light_ = Color(h.ambient_[0], h.ambient_[1], h.ambient_[2]);
+  std::vector<const Material *> mat_ptrs;
+  for (uint64_t i = 0; i < h.mats_.count_; i++) {
+    const MaterialRecord &r = mats[i];
+    auto mat = std::make_unique<Material>(Color(r.k_d_[0], r.k_d_[1], r.k_d_[2]),
+                                          Color(r.k_s_[0], r.k_s_[1], r.k_s_[2]), r.alpha_);
+    mat->emissive_ = r.emissive_ != 0;
+    mat_ptrs.push_back(mat.get());
+    scene.mats_[std::string(r.name_, strnlen(r.name_, sizeof(r.name_)))] = std::move(mat);
+  }
+  for (uint64_t i = 0; i < h.lights_.count_; i++) {
+    const LightRecord &r = lights[i];
+    scene.lights_.emplace_back(std::make_unique<Light>(Vec3(r.position_[0], r.position_[1], r.position_[2]),
+                                                       Color(r.intensity_[0], r.intensity_[1], r.intensity_[2])));
+  }
+  std::vector<const Prototype *> proto_ptrs;
+  for (uint64_t i = 0; i < h.protos_.count_; i++) {
+    const ProtoRecord &r = protos[i];
+    if (uint64_t(r.first_) + r.count_ > h.num_protos_objs_ || !fits_bvh(r.bvh_)) return fail();
+    auto proto = std::make_unique<Prototype>();
+    for (uint32_t k = r.first_; k < r.first_ + r.count_; k++) {
+      if (objs[k].type_ == ObjectType::Instance) return fail();
+      auto object = MakeObject(objs[k], mat_ptrs, proto_ptrs);
+      if (!object) return fail();
+      proto->objs_.push_back(std::move(object));
+    }
+    if (!adopt(proto->Bvh(), r.bvh_, proto->objs_)) return fail();
+    proto_ptrs.push_back(proto.get());
+    scene.protos_[std::string(r.name_, strnlen(r.name_, sizeof(r.name_)))] = std::move(proto);
+  }
+  for (uint64_t k = h.num_protos_objs_; k < h.objs_.count_; k++) {
+    auto object = MakeObject(objs[k], mat_ptrs, proto_ptrs);
+    if (!object) return fail();
+    scene.objs_.push_back(std::move(object));
+  }
+  for (uint64_t i = 0; i < h.tracks_.count_; i++) {
+    const TrackRecord &r = tracks[i];
+    if (r.target_ >= scene.objs_.size() || r.count_ == 0 || uint64_t(r.first_) + r.count_ > h.keys_.count_)
+      return fail();
+    auto *target = dynamic_cast<Instance *>(scene.objs_[r.target_].get());
+    if (!target) return fail();
+    std::vector<Keyframe> track_keys;
+    for (uint32_t k = r.first_; k < r.first_ + r.count_; k++) {
+      const KeyRecord &key = keys[k];
+      track_keys.push_back({key.time_, Vec3(key.translation_[0], key.translation_[1], key.translation_[2]),
+                            Quat(key.rotation_[3], key.rotation_[0], key.rotation_[1], key.rotation_[2]), key.scale_});
+    }
+    scene.tracks_.emplace_back(target, std::move(track_keys));
+  }
+  if (!adopt(scene.Bvh(), h.bvh_, scene.objs_)) return fail();
+
+  scene.cache_ = std::move(data);
+  scene.Compile(false);
+  return true;
+}
+
+void Copy(const Scene &from, Scene &to)
+{
+  // the BVHs are cloned rather than rebuilt, through the copies of their objects
+  std::unordered_map<const Object *, const Object *> copies;
+  auto clone = [&copies](BVH &to, const BVH &from) {
+    std::vector<const Object *> prims, unbounded;
+    for (const Object *obj : from.Prims()) prims.push_back(copies.at(obj));
+    for (const Object *obj : from.Unbounded()) unbounded.push_back(copies.at(obj));
+    to.Clone(from, std::move(prims), std::move(unbounded));
+  };
+
+  to.ambient_light_ = from.ambient_light_;
+  // the material ids of the records follow the order of mats_, as mat_table_ does
+  std::vector<const Material *> mat_ptrs;
+  for (const auto &mat : from.mats_) {
+    auto copy = std::make_unique<Material>(*mat.second);
+    mat_ptrs.push_back(copy.get());
+    to.mats_[mat.first] = std::move(copy);
+  }
+  for (const auto &light : from.lights_) to.lights_.push_back(std::make_unique<Light>(*light));
+  std::vector<const Prototype *> proto_ptrs;
+  std::unordered_map<const Prototype *, int> proto_ids;
+  for (const auto &proto : from.protos_) {
+    auto copy = std::make_unique<Prototype>();
+    for (const auto &object : proto.second->objs_) {
+      copy->objs_.push_back(MakeObject(object->Record(), mat_ptrs, proto_ptrs));
+      copies[object.get()] = copy->objs_.back().get();
+    }
+    clone(copy->Bvh(), proto.second->Bvh());
+    proto_ids[proto.second.get()] = int(proto_ptrs.size());
+    proto_ptrs.push_back(copy.get());
+    to.protos_[proto.first] = std::move(copy);
+  }
+  std::unordered_map<const Object *, Instance *> instances;
+  for (const auto &object : from.objs_) {
+    ObjectRecord record = object->Record();
+    const auto *instance = dynamic_cast<const Instance *>(object.get());
+    if (instance) record.proto_ = proto_ids.at(instance->Proto());
+    to.objs_.push_back(MakeObject(record, mat_ptrs, proto_ptrs));
+    copies[object.get()] = to.objs_.back().get();
+    if (instance) instances[instance] = static_cast<Instance *>(to.objs_.back().get());
+  }
+  for (const Track &track : from.tracks_) to.tracks_.emplace_back(instances.at(track.target_), track.keys_);
+  clone(to.Bvh(), from.Bvh());
+  to.caustics_ = from.caustics_;
+  to.irradiance_ = from.irradiance_;
+  to.guide_ = from.guide_;
+  to.Compile(false);
+}
+
+}
+}
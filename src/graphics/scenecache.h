@@ -0,0 +1,40 @@
+#pragma once
+
+#include "graphics/scene.h"
+
+#include <cstdint>
+#include <string>
+
+namespace VCL {
+
+// Versioned binary file holding a compiled scene: materials, lights,
+// prototypes, objects, animation tracks and the prebuilt BVHs. Everything
+// is stored as flat arrays addressed by offsets from the start of the file.
+// Loading maps the file and hands the BVH nodes to the scene as they are,
+// so nothing is rebuilt; the objects themselves are virtual and still get
+// constructed from their records.
+//
+// Two hashes guard the file: `source`, chosen by the caller to identify what
+// the scene was built from, and an FNV-1a hash of everything after the header,
+// BVH nodes included, which catches truncated or edited files. A mismatch of
+// either makes Load fail and the caller rebuilds and saves the scene again.
+namespace SceneCache {
+
+uint64_t Hash(const void *data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// call after Scene::Compile and before the scene is animated
+bool Save(const Scene &scene, const std::string &path, uint64_t source);
+
+// fills an empty scene and compiles it; false if the file is missing, from
+// another version or source, or damaged
+bool Load(Scene &scene, const std::string &path, uint64_t source);
+
+// fills an empty scene with a copy of a compiled one, through the same
+// records as Save and Load but without the file, and compiles it without
+// rebuilding: the BVH nodes are cloned, so Scene::Animate can refit the copy.
+// The renderer-owned caches are shared, not copied
+void Copy(const Scene &from, Scene &to);
+
+}
+
+}
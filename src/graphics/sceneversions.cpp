@@ -0,0 +1,71 @@
+#include "sceneversions.h"
+
+#include "scenecache.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace VCL {
+
+SceneVersions::SceneVersions(const Scene &first) :
+  latest_(new Version{nullptr, &first, 0})
+{
+  for (auto &pinned : pinned_) pinned.store(nullptr);
+}
+
+SceneVersions::~SceneVersions()
+{
+  for (Version *version : retired_) delete version;
+  delete latest_.load();
+}
+
+const Scene &SceneVersions::Pin(uint64_t &version, int reader)
+{
+  assert(0 <= reader && reader < kReaders);
+  // hazard pointer: once the slot holds the version and it is still the
+  // newest, Reclaim sees the slot before it could delete it
+  Version *latest = latest_.load();
+  for (;;) {
+    pinned_[reader].store(latest);
+    Version *now = latest_.load();
+    if (now == latest) break;
+    latest = now;
+  }
+  version = latest->number_;
+  return *latest->scene_;
+}
+
+void SceneVersions::Unpin(int reader)
+{
+  assert(0 <= reader && reader < kReaders);
+  pinned_[reader].store(nullptr);
+}
+
+uint64_t SceneVersions::Edit(const std::function<void(Scene &)> &edit)
+{
+  std::lock_guard<std::mutex> lock(edit_mutex_);
+  // only editors replace or delete versions, the newest one stays put meanwhile
+  const Version *latest = latest_.load();
+  auto scene = std::make_unique<Scene>();
+  SceneCache::Copy(*latest->scene_, *scene);
+  edit(*scene);
+  const Scene *copy = scene.get();
+  const uint64_t number = latest->number_ + 1;
+  retired_.push_back(latest_.exchange(new Version{std::move(scene), copy, number}));
+  Reclaim();
+  return number;
+}
+
+void SceneVersions::Reclaim()
+{
+  auto pinned = [this](const Version *version) {
+    for (const auto &slot : pinned_)
+      if (slot.load() == version) return true;
+    return false;
+  };
+  auto unpinned = std::partition(retired_.begin(), retired_.end(), pinned);
+  for (auto it = unpinned; it != retired_.end(); ++it) delete *it;
+  retired_.erase(unpinned, retired_.end());
+}
+
+}
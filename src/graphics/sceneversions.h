@@ -0,0 +1,66 @@
+#pragma once
+
+#include "graphics/scene.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace VCL {
+
+// Read-copy-update versions of a compiled scene, for edits of lights,
+// materials and transforms while passes render. A reader pins the newest
+// version for a pass and traces only that one; an editor copies the newest
+// version, changes the copy and publishes it with one atomic exchange.
+// Neither side waits for the other: Pin is a load and a hazard pointer store,
+// and a replaced version is deleted by a later Edit once no reader has it
+// pinned. Editors do wait for each other.
+class SceneVersions
+{
+public:
+
+  // pin slots, one per thread that renders
+  static constexpr int kReaders = 4;
+
+  // `first` is version 0; it is not copied, it must outlive this and stay
+  // unchanged, and it is never deleted here
+  explicit SceneVersions(const Scene &first);
+  ~SceneVersions();
+
+  SceneVersions(const SceneVersions &) = delete;
+  SceneVersions &operator=(const SceneVersions &) = delete;
+
+  // the newest version and its number; it stays valid until slot `reader`
+  // (0 <= reader < kReaders) pins again or unpins. Lock free
+  const Scene &Pin(uint64_t &version, int reader = 0);
+  void Unpin(int reader = 0);
+
+  // calls `edit` with a compiled copy of the newest version and publishes
+  // the copy, returns its number. `edit` leaves the copy compiled, as after
+  // any scene edit (Scene::Compile, Animate refits by itself). Thread safe
+  uint64_t Edit(const std::function<void(Scene &)> &edit);
+
+private:
+
+  struct Version
+  {
+    std::unique_ptr<Scene> owned_; // null for version 0
+    const Scene *scene_;
+    uint64_t number_;
+  };
+
+  // deletes the retired versions no slot has pinned; under edit_mutex_
+  void Reclaim();
+
+private:
+
+  std::atomic<Version *> latest_;
+  std::atomic<Version *> pinned_[kReaders];
+  std::mutex edit_mutex_;
+  std::vector<Version *> retired_;
+};
+
+}
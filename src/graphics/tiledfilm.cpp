@@ -0,0 +1,143 @@
+#include "tiledfilm.h"
+
+#include <algorithm>
+
+namespace VCL {
+namespace {
+bool Seek(std::FILE* f, uint64_t offset) {
+#ifdef _WIN32
+  return _fseeki64(f, int64_t(offset), SEEK_SET) == 0;
+#else
+  return fseeko(f, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+}  // namespace
+
+TiledFilm::TiledFilm(const std::string& path, int width, int height, int tile_size, int resident)
+    : width_(width), height_(height), tile_size_(tile_size) {
+  tiles_x_ = (width + tile_size - 1) / tile_size;
+  tiles_y_ = (height + tile_size - 1) / tile_size;
+  slot_of_.assign(size_t(tiles_x_) * tiles_y_, -1);
+  slots_.resize(std::max(resident, 1));
+  for (Tile& slot : slots_) {
+    slot.color_.resize(size_t(tile_size) * tile_size);
+    slot.cnt_.resize(size_t(tile_size) * tile_size);
+  }
+  file_ = std::fopen(path.c_str(), "w+b");
+  if (!file_) return;
+  // one byte at the end; tiles that were never written read back as zeros
+  const uint64_t tile_bytes = uint64_t(tile_size) * tile_size * (sizeof(Color) + sizeof(int));
+  const char zero = 0;
+  if (!Seek(file_, tile_bytes * slot_of_.size() - 1) || std::fwrite(&zero, 1, 1, file_) != 1) {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+TiledFilm::~TiledFilm() {
+  if (!file_) return;
+  Flush();
+  std::fclose(file_);
+}
+
+TiledFilm::Tile& TiledFilm::Acquire(int tx, int ty) {
+  const int index = ty * tiles_x_ + tx;
+  int slot = slot_of_[index];
+  if (slot < 0) {
+    // a free slot, or the least recently used one
+    slot = 0;
+    for (int i = 1; i < int(slots_.size()) && slots_[slot].index_ >= 0; ++i)
+      if (slots_[i].index_ < 0 || slots_[i].last_use_ < slots_[slot].last_use_) slot = i;
+    Tile& tile = slots_[slot];
+    if (tile.index_ >= 0) {
+      if (tile.dirty_) Store(tile);
+      slot_of_[tile.index_] = -1;
+    }
+    Load(tile, index);
+    slot_of_[index] = slot;
+  }
+  Tile& tile = slots_[slot];
+  tile.last_use_ = ++clock_;
+  tile.dirty_ = true;
+  return tile;
+}
+
+bool TiledFilm::Flush() {
+  bool ok = file_ != nullptr;
+  for (Tile& tile : slots_)
+    if (tile.index_ >= 0 && tile.dirty_) ok &= Store(tile);
+  if (file_) ok &= std::fflush(file_) == 0;
+  return ok;
+}
+
+bool TiledFilm::Load(Tile& tile, int index) {
+  tile.index_ = index;
+  tile.dirty_ = false;
+  tile.x0_ = (index % tiles_x_) * tile_size_;
+  tile.y0_ = (index / tiles_x_) * tile_size_;
+  tile.width_ = std::min(tile_size_, width_ - tile.x0_);
+  tile.height_ = std::min(tile_size_, height_ - tile.y0_);
+  const size_t size = tile.color_.size();
+  const uint64_t offset = uint64_t(index) * size * (sizeof(Color) + sizeof(int));
+  if (file_ && Seek(file_, offset) && std::fread(tile.color_.data(), sizeof(Color), size, file_) == size &&
+      std::fread(tile.cnt_.data(), sizeof(int), size, file_) == size)
+    return true;
+  std::fill(tile.color_.begin(), tile.color_.end(), Color::Zero());
+  std::fill(tile.cnt_.begin(), tile.cnt_.end(), 0);
+  return false;
+}
+
+bool TiledFilm::Store(Tile& tile) {
+  const size_t size = tile.color_.size();
+  const uint64_t offset = uint64_t(tile.index_) * size * (sizeof(Color) + sizeof(int));
+  tile.dirty_ = false;
+  return file_ && Seek(file_, offset) && std::fwrite(tile.color_.data(), sizeof(Color), size, file_) == size &&
+         std::fwrite(tile.cnt_.data(), sizeof(int), size, file_) == size;
+}
+
+void TiledFilm::ReadBand(int ty, std::vector<float>& band) {
+  band.resize(size_t(width_) * tile_size_ * 3);
+  for (int tx = 0; tx < tiles_x_; ++tx) {
+    Tile& tile = Acquire(tx, ty);
+    tile.dirty_ = false;  // only read
+    for (int r = 0; r < tile.height_; ++r)
+      for (int c = 0; c < tile.width_; ++c)
+        for (int k = 0; k < 3; ++k)
+          band[(size_t(r) * width_ + tile.x0_ + c) * 3 + k] = tile.color_[r * tile_size_ + c][k];
+  }
+}
+
+bool TiledFilm::WritePFM(const std::string& path) {
+  if (!Flush()) return false;
+  std::FILE* f = std::fopen(path.c_str(), "wb");
+  if (!f) return false;
+  // PFM rows are bottom-up like ours
+  bool ok = std::fprintf(f, "PF\n%d %d\n-1.0\n", width_, height_) > 0;
+  std::vector<float> band;
+  for (int ty = 0; ty < tiles_y_ && ok; ++ty) {
+    ReadBand(ty, band);
+    const size_t count = size_t(width_) * std::min(tile_size_, height_ - ty * tile_size_) * 3;
+    ok = std::fwrite(band.data(), sizeof(float), count, f) == count;
+  }
+  return std::fclose(f) == 0 && ok;
+}
+
+bool TiledFilm::WritePPM(const std::string& path, Tonemapper tonemapper) {
+  if (!Flush()) return false;
+  std::FILE* f = std::fopen(path.c_str(), "wb");
+  if (!f) return false;
+  bool ok = std::fprintf(f, "P6\n%d %d\n255\n", width_, height_) > 0;
+  std::vector<float> band;
+  std::vector<unsigned char> bytes;
+  for (int ty = tiles_y_ - 1; ty >= 0 && ok; --ty) {
+    ReadBand(ty, band);
+    const int rows = std::min(tile_size_, height_ - ty * tile_size_);
+    bytes.resize(size_t(width_) * rows * 3);
+    Tonemap(band.data(), width_ * rows, bytes.data(), 3, tonemapper);
+    // PPM rows are top-down
+    for (int r = rows - 1; r >= 0 && ok; --r)
+      ok = std::fwrite(&bytes[size_t(r) * width_ * 3], 1, size_t(width_) * 3, f) == size_t(width_) * 3;
+  }
+  return std::fclose(f) == 0 && ok;
+}
+};  // namespace VCL
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "graphics/tonemap.h"
+
+namespace VCL {
+// Out-of-core counterpart of Film for images too large to keep in memory.
+// The image is split into square tiles stored one after another in a file;
+// at most `resident` tiles are held in memory and the least recently used
+// one is written back when another is needed. Memory use depends on the
+// tile size and count, not on the image size.
+// Tiles are acquired by one thread; samples within a tile may be added in
+// parallel as long as no two threads share a pixel.
+class TiledFilm {
+ public:
+  struct Tile {
+    int x0_ = 0, y0_ = 0;  // lower left pixel
+    int width_ = 0, height_ = 0;  // clipped at the image border
+    int index_ = -1;  // tile number, -1 while the slot is unused
+    bool dirty_ = false;
+    uint64_t last_use_ = 0;
+    std::vector<Color> color_;  // running mean, tile size squared
+    std::vector<int> cnt_;
+
+    // x, y in image coordinates
+    void AddSample(int x, int y, const Color& color, int tile_size) {
+      const int i = (y - y0_) * tile_size + (x - x0_);
+      color_[i] += (color - color_[i]) / (++cnt_[i]);
+    }
+  };
+
+  int width_;
+  int height_;
+  int tile_size_;
+
+  // creates or truncates `path`; check Ok()
+  TiledFilm(const std::string& path, int width, int height, int tile_size, int resident);
+  ~TiledFilm();
+
+  bool Ok() const { return file_ != nullptr; }
+  int TilesX() const { return tiles_x_; }
+  int TilesY() const { return tiles_y_; }
+
+  // pages the tile in, marked dirty; stays valid until the next Acquire
+  Tile& Acquire(int tx, int ty);
+  // writes every dirty resident tile back
+  bool Flush();
+
+  // stream the image out one row of tiles at a time: linear PFM, and
+  // tonemapped binary PPM
+  bool WritePFM(const std::string& path);
+  bool WritePPM(const std::string& path, Tonemapper tonemapper);
+
+ private:
+  bool Load(Tile& tile, int index);
+  bool Store(Tile& tile);
+  // mean colors of tile row `ty`, rows bottom-up, width_ * tile_size_ * 3 floats
+  void ReadBand(int ty, std::vector<float>& band);
+
+  std::FILE* file_ = nullptr;
+  int tiles_x_ = 0, tiles_y_ = 0;
+  std::vector<Tile> slots_;
+  std::vector<int> slot_of_;  // per tile, -1 if not resident
+  uint64_t clock_ = 0;
+};
+};  // namespace VCL
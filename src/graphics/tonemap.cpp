@@ -0,0 +1,82 @@
+#include "tonemap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace VCL {
+namespace {
+constexpr int LUT_SIZE = 4096;
+
+// x^(1/2.2) over [0, 1], sampled at LUT_SIZE points evenly spaced in
+// sqrt(x); spacing linear in x would skip the darkest 8-bit codes
+struct GammaLut {
+  unsigned char table_[LUT_SIZE];
+  GammaLut() {
+    for (int i = 0; i < LUT_SIZE; ++i)
+      table_[i] = (unsigned char)std::round(std::pow(float(i) / (LUT_SIZE - 1), 2 / 2.2f) * 255);
+  }
+};
+
+const GammaLut& Lut() {
+  static const GammaLut lut;
+  return lut;
+}
+
+template <Tonemapper T>
+inline float Map(float x) {
+  x = x > 0.0f ? x : 0.0f;  // also flushes NaN
+  if constexpr (T == Tonemapper::Reinhard) {
+    x = x / (1.0f + x);
+  } else if constexpr (T == Tonemapper::ACES) {
+    // Narkowicz's fit of the ACES filmic curve
+    x = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+  }
+  return x < 1.0f ? x : 1.0f;
+}
+
+// `count` RGB floats to `channels` bytes per pixel, alpha left alone
+template <Tonemapper T>
+void MapPixels(const float* src, int count, unsigned char* dst, int channels) {
+  const unsigned char* table = Lut().table_;
+#pragma omp parallel for simd
+  for (int i = 0; i < count; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      const int idx = int(std::sqrt(Map<T>(src[3 * i + c])) * (LUT_SIZE - 1) + 0.5f);
+      dst[channels * i + c] = table[idx];
+    }
+  }
+}
+}  // namespace
+
+void Resolve(const Film& film, Framebuffer* framebuffer, Tonemapper tonemapper) {
+  Tonemap(film.color_[0].data(), film.width_ * film.height_, framebuffer->color_, 4, tonemapper);
+}
+
+void Tonemap(const float* src, int count, unsigned char* dst, int channels, Tonemapper tonemapper) {
+  switch (tonemapper) {
+    case Tonemapper::Clamp: MapPixels<Tonemapper::Clamp>(src, count, dst, channels); break;
+    case Tonemapper::Reinhard: MapPixels<Tonemapper::Reinhard>(src, count, dst, channels); break;
+    case Tonemapper::ACES: MapPixels<Tonemapper::ACES>(src, count, dst, channels); break;
+  }
+}
+
+void FalseColor(const float* values, int count, unsigned char* dst) {
+  if (count <= 0) return;
+  std::vector<float> sorted(values, values + count);
+  const int k = std::min(count - 1, int(count * 0.99f));
+  std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+  const float scale = sorted[k] > 0 ? 1.0f / sorted[k] : 0.0f;
+  // blue, cyan, green, yellow, red
+  static const float stops[5][3] = {{0, 0, 0.5f}, {0, 0.8f, 1}, {0.1f, 0.9f, 0.1f}, {1, 0.9f, 0}, {0.9f, 0, 0}};
+#pragma omp parallel for
+  for (int i = 0; i < count; ++i) {
+    float t = values[i] * scale;
+    t = t > 0.0f ? (t < 1.0f ? t : 1.0f) * 4 : 0.0f;  // also flushes NaN
+    const int s = std::min(int(t), 3);
+    const float f = t - s;
+    for (int c = 0; c < 3; ++c)
+      dst[3 * i + c] = (unsigned char)((stops[s][c] + (stops[s + 1][c] - stops[s][c]) * f) * 255 + 0.5f);
+  }
+}
+};  // namespace VCL
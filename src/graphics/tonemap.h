@@ -0,0 +1,20 @@
+#pragma once
+
+#include "graphics/film.h"
+#include "graphics/framebuffer.h"
+
+namespace VCL {
+enum class Tonemapper : unsigned char { Clamp = 0, Reinhard, ACES };
+
+// Converts the float film into the 8-bit framebuffer. Runs once per presented
+// frame instead of once per sample; gamma encoding goes through a lookup table.
+void Resolve(const Film& film, Framebuffer* framebuffer, Tonemapper tonemapper);
+
+// the same for `count` RGB float pixels written to `channels` bytes each,
+// for outputs that never hold the whole image
+void Tonemap(const float* src, int count, unsigned char* dst, int channels, Tonemapper tonemapper);
+
+// heatmap of `count` scalars as RGB bytes, blue (0) through red; the scale
+// is set by the 99th percentile so that a few outliers do not flatten the rest
+void FalseColor(const float* values, int count, unsigned char* dst);
+};  // namespace VCL
@@ -0,0 +1,134 @@
+#include "touchmap.h"
+
+#include "scene.h"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace VCL {
+
+TouchMap::TouchMap(const Scene &scene, int width, int height, int tile) :
+  objects_(int(scene.objs_.size())),
+  materials_(int(scene.mat_table_.size())),
+  lights_(int(scene.lights_.size())),
+  box_(scene.Bvh().Bounds()),
+  tile_(tile),
+  tiles_x_((width + tile - 1) / tile),
+  tiles_y_((height + tile - 1) / tile)
+{
+  // a little margin keeps hits on the outer walls inside the grid
+  if (box_.Bounded()) {
+    const Vec3 margin = (box_.max_ - box_.min_) * real(1e-3) + Vec3::Constant(real(1e-4));
+    box_.min_ -= margin;
+    box_.max_ += margin;
+    voxel_ = (box_.max_ - box_.min_) / kGrid;
+  }
+  const int bits = objects_ + materials_ + lights_ + kGrid * kGrid * kGrid;
+  words_ = (bits + 63) / 64;
+  bits_.assign(size_t(Tiles()) * words_, 0);
+  pending_.assign(omp_get_max_threads(), bits_);
+}
+
+uint64_t *TouchMap::Bits(int tile)
+{
+  return pending_[omp_get_thread_num()].data() + size_t(tile) * words_;
+}
+
+void TouchMap::RecordObject(uint64_t *bits, const Object *top, const Object *obj) const
+{
+  if (top->id_ >= 0 && top->id_ < objects_) Set(bits, top->id_);
+  if (obj->MatId() >= 0 && obj->MatId() < materials_) Set(bits, objects_ + obj->MatId());
+}
+
+void TouchMap::RecordLight(uint64_t *bits, int light) const
+{
+  if (light < lights_) Set(bits, objects_ + materials_ + light);
+}
+
+void TouchMap::RecordRay(uint64_t *bits, const Ray &ray, const Hit *hit, bool space) const
+{
+  if (hit) RecordObject(bits, hit->top_, hit->obj_);
+  if (!space || !box_.Bounded()) return;
+
+  // the part of the ray inside the grid; NaN slabs of axis parallel rays drop out of min/max
+  real t0 = 0, t1 = hit ? hit->t_ : std::numeric_limits<real>::infinity();
+  for (int a = 0; a < 3; a++) {
+    const real inv = 1 / ray.dir_[a];
+    real near = (box_.min_[a] - ray.ori_[a]) * inv;
+    real far = (box_.max_[a] - ray.ori_[a]) * inv;
+    if (near > far) std::swap(near, far);
+    t0 = std::max(t0, near);
+    t1 = std::min(t1, far);
+  }
+  if (!(t0 <= t1)) return;
+
+  // voxel walk from the entry point, Amanatides and Woo
+  const Vec3 p = (ray.ori_ + ray.dir_ * t0 - box_.min_).cwiseQuotient(voxel_);
+  int cell[3], step[3];
+  real next[3], delta[3];
+  for (int a = 0; a < 3; a++) {
+    cell[a] = std::clamp(int(std::floor(p[a])), 0, kGrid - 1);
+    step[a] = ray.dir_[a] > 0 ? 1 : -1;
+    if (ray.dir_[a] == 0) {
+      next[a] = delta[a] = std::numeric_limits<real>::infinity();
+      continue;
+    }
+    delta[a] = voxel_[a] / std::abs(ray.dir_[a]);
+    next[a] = t0 + (ray.dir_[a] > 0 ? cell[a] + 1 - p[a] : p[a] - cell[a]) * delta[a];
+  }
+  for (;;) {
+    Set(bits, objects_ + materials_ + lights_ + (cell[2] * kGrid + cell[1]) * kGrid + cell[0]);
+    const int a = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+    if (next[a] > t1) break;
+    cell[a] += step[a];
+    if (cell[a] < 0 || cell[a] >= kGrid) break;
+    next[a] += delta[a];
+  }
+}
+
+void TouchMap::Commit()
+{
+  for (auto &pending : pending_) {
+    for (size_t i = 0; i < bits_.size(); i++) bits_[i] |= pending[i];
+    std::fill(pending.begin(), pending.end(), 0);
+  }
+}
+
+bool TouchMap::Touched(int tile, const std::vector<int> &objects, const std::vector<int> &materials,
+                       const std::vector<int> &lights, const std::vector<AABB> &bounds) const
+{
+  const uint64_t *bits = bits_.data() + size_t(tile) * words_;
+  for (int id : objects)
+    if (id >= 0 && id < objects_ && Test(bits, id)) return true;
+  for (int id : materials)
+    if (id >= 0 && id < materials_ && Test(bits, objects_ + id)) return true;
+  for (int id : lights)
+    if (id >= 0 && id < lights_ && Test(bits, objects_ + materials_ + id)) return true;
+
+  for (const AABB &b : bounds) {
+    if (!b.Bounded() || !box_.Bounded()) return true; // no telling where its rays went
+    int lo[3], hi[3];
+    bool inside = true;
+    for (int a = 0; a < 3; a++) {
+      lo[a] = std::max(int(std::floor((b.min_[a] - box_.min_[a]) / voxel_[a])), 0);
+      hi[a] = std::min(int(std::floor((b.max_[a] - box_.min_[a]) / voxel_[a])), kGrid - 1);
+      inside &= lo[a] <= hi[a];
+    }
+    if (!inside) continue;
+    for (int z = lo[2]; z <= hi[2]; z++)
+      for (int y = lo[1]; y <= hi[1]; y++)
+        for (int x = lo[0]; x <= hi[0]; x++)
+          if (Test(bits, objects_ + materials_ + lights_ + (z * kGrid + y) * kGrid + x)) return true;
+  }
+  return false;
+}
+
+void TouchMap::ClearTile(int tile)
+{
+  std::fill(bits_.begin() + size_t(tile) * words_, bits_.begin() + size_t(tile + 1) * words_, 0);
+}
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "graphics/object.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace VCL {
+
+class Scene;
+
+// What the rays of every image tile touched, to find the tiles that an edit
+// of the scene can change. Per tile there is one bit for every scene level
+// object and every material hit, every point light shaded and every voxel
+// of a coarse grid over the scene that a ray crossed. Lights and emitters
+// count as soon as a sample considers them, whether their shadow ray gets
+// through or not: moving a light changes what it reaches either way.
+// Bits are numbered by Object::id_, the order of Scene::mat_table_ and of
+// Scene::lights_, so edits must keep those (objects may be appended).
+// Samples record through g_touch into per-thread buffers, which Commit
+// merges; the merged bits are only read in between. Walking the grid costs
+// about as much as tracing the ray in a small scene, and what the rays of
+// a tile cross changes little from pass to pass, so the renderer has every
+// kSpacePasses-th pass of a tile record it, starting with the first.
+class TouchMap
+{
+public:
+
+  static constexpr int kGrid = 8; // voxels per axis over the scene bounds
+  static constexpr int kSpacePasses = 4;
+
+  TouchMap(const Scene &scene, int width, int height, int tile);
+
+  int TileSize() const { return tile_; }
+  int TilesX() const { return tiles_x_; }
+  int Tiles() const { return tiles_x_ * tiles_y_; }
+  int Tile(int x, int y) const { return y / tile_ * tiles_x_ + x / tile_; }
+
+  // the calling thread's record of `tile`, for g_touch
+  uint64_t *Bits(int tile);
+
+  // called through g_touch by the scene and the kernels; `hit` is null for
+  // a miss, `obj` is the primitive of `top`; `space` walks the voxels
+  void RecordRay(uint64_t *bits, const Ray &ray, const Hit *hit, bool space) const;
+  void RecordObject(uint64_t *bits, const Object *top, const Object *obj) const;
+  void RecordLight(uint64_t *bits, int light) const;
+
+  // merges what the threads recorded; not thread safe
+  void Commit();
+
+  // whether `tile` touched one of the objects, materials or lights, or sent
+  // a ray through the space of one of `bounds`
+  bool Touched(int tile, const std::vector<int> &objects, const std::vector<int> &materials,
+               const std::vector<int> &lights, const std::vector<AABB> &bounds) const;
+
+  // forgets what `tile` touched, before it is rendered again
+  void ClearTile(int tile);
+
+private:
+
+  static void Set(uint64_t *bits, int bit) { bits[bit >> 6] |= uint64_t(1) << (bit & 63); }
+  static bool Test(const uint64_t *bits, int bit) { return bits[bit >> 6] >> (bit & 63) & 1; }
+
+private:
+
+  int objects_, materials_, lights_; // counts; the bits follow in this order, then the voxels
+  AABB box_;                         // the grid, unbounded if the scene is
+  Vec3 voxel_;
+
+  int tile_, tiles_x_, tiles_y_;
+  int words_; // per tile
+  std::vector<uint64_t> bits_;
+  std::vector<std::vector<uint64_t>> pending_; // one per thread
+};
+
+// where the calling thread's sample records what it touches, set by the
+// renderer around the kernel call; nothing is recorded while bits_ is null
+struct TouchTarget
+{
+  const TouchMap *map_ = nullptr;
+  uint64_t *bits_ = nullptr;
+  bool space_ = false; // also the voxels the rays cross
+};
+
+inline thread_local TouchTarget g_touch;
+
+}
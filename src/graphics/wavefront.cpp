@@ -0,0 +1,250 @@
+#include "wavefront.h"
+
+#include "common/alloccheck.h"
+#include "common/helperfunc.h"
+#include "graphics/globillum.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace VCL {
+
+Wavefront::Wavefront(const Scene &scene, const bool MonteCarlo, const bool SortRays, const bool FastMath) :
+  scene_(&scene),
+  MonteCarlo_(MonteCarlo),
+  sort_rays_(SortRays),
+  fast_math_(FastMath),
+  max_depth_(MonteCarlo ? 5 : 10)
+{ }
+
+void Wavefront::Reserve(int count)
+{
+  if (int(ox_.size()) >= count) return;
+  for (auto *v : {&ox_, &oy_, &oz_, &dx_, &dy_, &dz_, &wr_, &wg_, &wb_, &lr_, &lg_, &lb_, &px_, &py_, &pz_, &nx_, &ny_, &nz_})
+    v->resize(count);
+  hit_obj_.resize(count);
+  // the stages resize these within the batch
+  active_.reserve(count);
+  shade_queue_.reserve(count);
+  alive_.reserve(count);
+  sort_keys_.reserve(count);
+  sort_scratch_.Reserve(count);
+  ReserveScene(count);
+}
+
+void Wavefront::SetScene(const Scene &scene)
+{
+  scene_ = &scene;
+  ReserveScene(ox_.size());
+}
+
+void Wavefront::ReserveScene(size_t count)
+{
+  mat_offset_.reserve(scene_->mat_table_.size() + 1);
+  mat_cursor_.reserve(scene_->mat_table_.size());
+  shadow_valid_.reserve(count * scene_->lights_.size());
+  shadow_color_.reserve(count * scene_->lights_.size());
+}
+
+void Wavefront::Render(const Camera &camera, int width, int height,
+                       const int *pixels, int count, Color *out, Aov *aovs)
+{
+  Reserve(count);
+  Generate(camera, width, height, pixels, count);
+  if (aovs) std::fill(aovs, aovs + count, Aov());
+  for (int depth = 0; depth < max_depth_ && !active_.empty(); depth++) {
+    // camera rays are coherent already
+    if (sort_rays_ && depth > 0) SortRays();
+    Extend();
+    SortByMaterial();
+    Shade(depth, aovs);
+    if (!MonteCarlo_) Shadow();
+  }
+  Accumulate(out, count);
+}
+
+void Wavefront::Generate(const Camera &camera, int width, int height, const int *pixels, int count)
+{
+  const real dx = real(1) / width;
+  const real dy = real(1) / height;
+
+  active_.resize(count);
+  # pragma omp parallel for
+  for (int i = 0; i < count; ++i) {
+    AllocFree alloc_free;
+    const int x = pixels[i] % width;
+    const int y = pixels[i] / width;
+    const Ray ray = camera.GenerateRay(dx * (x + rand01()), dy * (y + rand01()));
+    ox_[i] = ray.ori_[0]; oy_[i] = ray.ori_[1]; oz_[i] = ray.ori_[2];
+    dx_[i] = ray.dir_[0]; dy_[i] = ray.dir_[1]; dz_[i] = ray.dir_[2];
+    wr_[i] = wg_[i] = wb_[i] = 1;
+    lr_[i] = lg_[i] = lb_[i] = 0;
+    active_[i] = i;
+  }
+}
+
+void Wavefront::SortRays()
+{
+  const int n = int(active_.size());
+  real lo[3] = {std::numeric_limits<real>::max(), std::numeric_limits<real>::max(), std::numeric_limits<real>::max()};
+  real hi[3] = {std::numeric_limits<real>::lowest(), std::numeric_limits<real>::lowest(), std::numeric_limits<real>::lowest()};
+  # pragma omp parallel for reduction(min : lo[:3]) reduction(max : hi[:3])
+  for (int k = 0; k < n; ++k) {
+    AllocFree alloc_free;
+    const int i = active_[k];
+    lo[0] = std::min(lo[0], ox_[i]); hi[0] = std::max(hi[0], ox_[i]);
+    lo[1] = std::min(lo[1], oy_[i]); hi[1] = std::max(hi[1], oy_[i]);
+    lo[2] = std::min(lo[2], oz_[i]); hi[2] = std::max(hi[2], oz_[i]);
+  }
+
+  // 1024 cells per axis over the bounds of the current origins
+  real scale[3];
+  for (int a = 0; a < 3; a++) scale[a] = hi[a] > lo[a] ? real(1023.99) / (hi[a] - lo[a]) : 0;
+
+  sort_keys_.resize(n);
+  # pragma omp parallel for
+  for (int k = 0; k < n; ++k) {
+    AllocFree alloc_free;
+    const int i = active_[k];
+    const uint32_t octant = (dx_[i] < 0 ? 4 : 0) | (dy_[i] < 0 ? 2 : 0) | (dz_[i] < 0 ? 1 : 0);
+    const uint32_t morton = MortonCode3(uint32_t((ox_[i] - lo[0]) * scale[0]),
+                                        uint32_t((oy_[i] - lo[1]) * scale[1]),
+                                        uint32_t((oz_[i] - lo[2]) * scale[2]));
+    sort_keys_[k] = (uint64_t(octant) << 30) | morton;
+  }
+  RadixSortPairs(sort_keys_, active_, 33, sort_scratch_);
+}
+
+void Wavefront::Extend()
+{
+  const int n = int(active_.size());
+  # pragma omp parallel for
+  for (int k = 0; k < n; ++k) {
+    AllocFree alloc_free;
+    const int i = active_[k];
+    Vec3 pos, n;
+    hit_obj_[i] = scene_->Intersect(Ray(Vec3(ox_[i], oy_[i], oz_[i]), Vec3(dx_[i], dy_[i], dz_[i])), pos, n);
+    px_[i] = pos[0]; py_[i] = pos[1]; pz_[i] = pos[2];
+    nx_[i] = n[0]; ny_[i] = n[1]; nz_[i] = n[2];
+  }
+}
+
+void Wavefront::SortByMaterial()
+{
+  // counting sort of the surviving paths by material, misses are dropped
+  mat_offset_.assign(scene_->mat_table_.size() + 1, 0);
+  for (const int i : active_)
+    if (hit_obj_[i]) mat_offset_[hit_obj_[i]->MatId() + 1]++;
+  for (size_t m = 1; m < mat_offset_.size(); m++) mat_offset_[m] += mat_offset_[m - 1];
+
+  shade_queue_.resize(mat_offset_.back());
+  mat_cursor_.assign(mat_offset_.begin(), mat_offset_.end() - 1);
+  for (const int i : active_)
+    if (hit_obj_[i]) shade_queue_[mat_cursor_[hit_obj_[i]->MatId()]++] = i;
+}
+
+void Wavefront::Shade(int depth, Aov *aovs)
+{
+  const int n = int(shade_queue_.size());
+  const int num_lights = int(scene_->lights_.size());
+  if (!MonteCarlo_) {
+    shadow_valid_.assign(size_t(n) * num_lights, 0);
+    shadow_color_.resize(size_t(n) * num_lights);
+  }
+
+  alive_.assign(n, 0);
+
+  # pragma omp parallel for
+  for (int q = 0; q < n; ++q) {
+    AllocFree alloc_free;
+    const int i = shade_queue_[q];
+    const CompiledMaterial &mat = scene_->Mat(hit_obj_[i]);
+    const Vec3 pos(px_[i], py_[i], pz_[i]);
+    const Vec3 dir(dx_[i], dy_[i], dz_[i]);
+    const Vec3 normal(nx_[i], ny_[i], nz_[i]);
+    Color w(wr_[i], wg_[i], wb_[i]);
+    if (aovs && depth == 0) aovs[i] = {mat.k_d_, normal, (pos - Vec3(ox_[i], oy_[i], oz_[i])).norm()};
+
+    if (MonteCarlo_) {
+      if (mat.type_ == MaterialType::Emissive) {
+        const Color l = w * mat.k_d_;
+        lr_[i] = l[0]; lg_[i] = l[1]; lb_[i] = l[2];
+        continue;
+      }
+      Color weight(1, 1, 1);
+      const Vec3 d = fast_math_ ? GlobIllum::Sample<true>(mat, normal, -dir, weight)
+                                : GlobIllum::Sample<false>(mat, normal, -dir, weight);
+      if (!weight.any()) continue;
+      w *= weight;
+      ox_[i] = pos[0] + real(0.01) * d[0]; oy_[i] = pos[1] + real(0.01) * d[1]; oz_[i] = pos[2] + real(0.01) * d[2];
+      dx_[i] = d[0]; dy_[i] = d[1]; dz_[i] = d[2];
+    }
+    else {
+      // Phong terms go to the shadow queue, ambient is added right away
+      const Color k = w * mat.local_;
+      for (int j = 0; j < num_lights; j++) {
+        shadow_valid_[size_t(q) * num_lights + j] = 1;
+        const Light &tlight = *scene_->lights_[j];
+        const Color phong = fast_math_ ? GlobIllum::PhongLight<true>(mat, pos, normal, dir, tlight)
+                                       : GlobIllum::PhongLight<false>(mat, pos, normal, dir, tlight);
+        shadow_color_[size_t(q) * num_lights + j] = k * phong;
+      }
+      const Color ambient = k * scene_->ambient_light_ * mat.k_d_;
+      lr_[i] += ambient[0]; lg_[i] += ambient[1]; lb_[i] += ambient[2];
+
+      w *= mat.reflectance_;
+      const Vec3 d = dir - 2 * dir.dot(normal) * normal;
+      ox_[i] = pos[0] + real(0.00001) * d[0]; oy_[i] = pos[1] + real(0.00001) * d[1]; oz_[i] = pos[2] + real(0.00001) * d[2];
+      dx_[i] = d[0]; dy_[i] = d[1]; dz_[i] = d[2];
+      if (!w.any()) continue;
+    }
+    wr_[i] = w[0]; wg_[i] = w[1]; wb_[i] = w[2];
+    alive_[q] = 1;
+  }
+
+  // paths ending after the last bounce carry no radiance in path tracing
+  active_.clear();
+  if (depth + 1 < max_depth_)
+    for (int q = 0; q < n; ++q)
+      if (alive_[q]) active_.push_back(shade_queue_[q]);
+}
+
+void Wavefront::Shadow()
+{
+  const int n = int(shade_queue_.size());
+  const int num_lights = int(scene_->lights_.size());
+
+  # pragma omp parallel for
+  for (int s = 0; s < n * num_lights; ++s) {
+    AllocFree alloc_free;
+    if (!shadow_valid_[s]) continue;
+    const int i = shade_queue_[s / num_lights];
+    const Vec3 &target = scene_->lights_[s % num_lights]->position;
+    const Vec3 pos(px_[i], py_[i], pz_[i]);
+    Vec3 test_pos;
+    const Object *test_obj = scene_->Intersect(Ray(pos + 0.01 * (target - pos), (target - pos).normalized()), test_pos);
+    if (!test_obj || scene_->Mat(test_obj).type_ != MaterialType::Emissive) shadow_valid_[s] = 0;
+  }
+
+  # pragma omp parallel for
+  for (int q = 0; q < n; ++q) {
+    AllocFree alloc_free;
+    const int i = shade_queue_[q];
+    for (int j = 0; j < num_lights; j++) {
+      const size_t s = size_t(q) * num_lights + j;
+      if (!shadow_valid_[s]) continue;
+      lr_[i] += shadow_color_[s][0]; lg_[i] += shadow_color_[s][1]; lb_[i] += shadow_color_[s][2];
+    }
+  }
+}
+
+void Wavefront::Accumulate(Color *out, int count)
+{
+  # pragma omp parallel for
+  for (int i = 0; i < count; ++i) {
+    AllocFree alloc_free;
+    out[i] = Color(lr_[i], lg_[i], lb_[i]);
+  }
+}
+
+}
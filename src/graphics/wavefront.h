@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+
+#include "common/helperfunc.h"
+#include "graphics/camera.h"
+#include "graphics/film.h"
+#include "graphics/scene.h"
+
+namespace VCL {
+
+// Wavefront integrator: a whole batch of paths is kept in SoA buffers and
+// advanced stage by stage (generate -> extend -> shade -> shadow -> accumulate)
+// instead of running every path to completion one pixel at a time.
+// Between stages the live paths are compacted and grouped by material, so the
+// intersection and shading loops run over coherent batches.
+// Secondary rays can optionally be reordered by direction octant and origin
+// Morton cell before they are traced, which keeps traversal memory access
+// coherent once the geometry no longer fits in cache.
+class Wavefront
+{
+public:
+
+  // `FastMath` shades and samples with the approximations of
+  // common/fastmath.h, as GlobIllum::FAST_MATH does in the per-pixel kernels
+  Wavefront(const Scene &scene, const bool MonteCarlo, const bool SortRays = false, const bool FastMath = false);
+
+  // trace one sample for each pixel in `pixels` (y * width + x), results in
+  // `out` and, if given, the first hits in `aovs`
+  void Render(const Camera &camera, int width, int height,
+              const int *pixels, int count, Color *out, Aov *aovs = nullptr);
+
+  // sizes the buffers for batches of up to `count` paths, which then render
+  // without allocating; Render grows them as well
+  void Reserve(int count);
+
+  // traces `scene` from the next Render on, a newer version of the scene it
+  // was created with; the buffers grow for added lights and materials
+  void SetScene(const Scene &scene);
+
+private:
+
+  // the buffers sized by the lights and materials of the scene
+  void ReserveScene(size_t count);
+  void Generate(const Camera &camera, int width, int height, const int *pixels, int count);
+  void SortRays();
+  void Extend();
+  void SortByMaterial();
+  void Shade(int depth, Aov *aovs);
+  void Shadow();
+  void Accumulate(Color *out, int count);
+
+private:
+
+  const Scene *scene_;
+  const bool MonteCarlo_;
+  const bool sort_rays_;
+  const bool fast_math_;
+  const int max_depth_;
+
+  // path states
+  std::vector<real> ox_, oy_, oz_;
+  std::vector<real> dx_, dy_, dz_;
+  std::vector<real> wr_, wg_, wb_; // throughput
+  std::vector<real> lr_, lg_, lb_; // radiance
+  // hit records
+  std::vector<const Object *> hit_obj_;
+  std::vector<real> px_, py_, pz_;
+  std::vector<real> nx_, ny_, nz_;
+  // ray sort keys: direction octant (3 bits) above the origin Morton code (30 bits)
+  std::vector<uint64_t> sort_keys_;
+  RadixScratch sort_scratch_;
+  // queues
+  std::vector<int> active_;
+  std::vector<int> shade_queue_;
+  std::vector<int> mat_offset_;
+  std::vector<int> mat_cursor_; // scratch for SortByMaterial
+  std::vector<char> alive_; // 1 if the shaded path continues to the next bounce
+  // shadow rays, lights_.size() slots per shaded path; a slot holds the
+  // contribution of its light if unoccluded, or zero
+  std::vector<char> shadow_valid_;
+  std::vector<Color> shadow_color_;
+};
+
+}
@@ -14,8 +14,79 @@ int main() {
   Renderer renderer;
   // switch between ray-tracing and path-tracing
   const bool MonteCarlo = false;
+  // trace batches of paths stage by stage instead of one pixel at a time
+  const bool Wavefront = false;
+  // wavefront only: reorder secondary rays by direction and origin before tracing
+  const bool SortRays = false;
   
-  renderer.Init("Visual Computing", 800, 600,MonteCarlo);
+  // display transform applied when a frame is presented: Clamp, Reinhard or ACES
+  renderer.tonemapper_ = Tonemapper::Clamp;
+  // when the camera moves, reproject the accumulated samples into the new view
+  // (diffuse surfaces that stay visible keep up to reproject_history_ samples
+  // per pixel) instead of starting over
+  renderer.reproject_ = true;
+  renderer.reproject_history_ = 64;
+  // specialized integrator kernel: SHADOW_RAYS and SPECULAR (ray-tracing),
+  // SPECULAR, NEE and CAUSTICS (path-tracing); unused flags are ignored.
+  // CAUSTICS adds a progressive photon map for light reflected by the mirror
+  // and the metal ball; IRRADIANCE_CACHE (ray-tracing) replaces the constant
+  // ambient term with cached indirect diffuse light; GUIDING (path-tracing)
+  // learns where light comes from and samples diffuse bounces towards it
+  // (all three per-pixel mode only, not wavefront). RESAMPLED_DIRECT (both
+  // modes, with NEE for path-tracing) shades one light per point, picked by
+  // resampling and reused across neighbouring pixels and passes: one shadow
+  // ray instead of one per light, for scenes with many lights
+  // (also per-pixel only). FAST_MATH (both modes, per-pixel and wavefront)
+  // swaps libm's pow, sin and cos in shading and sampling for polynomial
+  // approximations
+  renderer.kernel_features_ = GlobIllum::SHADOW_RAYS | GlobIllum::SPECULAR;
+  renderer.caustic_photons_ = 100000;
+  renderer.caustic_radius_ = 0.05f;
+  renderer.irradiance_cell_ = 0.1f;
+  renderer.guide_cell_ = 0.25f;
+  // stream resolved frames for remote monitoring: "-" (stdout), a file or
+  // named pipe, or "tcp:<port>" on localhost; empty disables streaming
+  renderer.stream_target_ = "";
+  renderer.stream_format_ = StreamFormat::Y4M;
+  renderer.stream_interval_ = 1.0f;
+  // write <prefix>.exr/.hdr/.pfm (linear) and .png when rendering stops, and
+  // every checkpoint_interval_ seconds if that is not 0; empty disables output
+  renderer.output_prefix_ = "";
+  renderer.output_formats_ = {".exr", ".png"};
+  renderer.output_aovs_ = false;
+  // per-pixel cost for profiling (per-pixel mode only): time, intersection
+  // tests, bounces and shadow rays per sample as <prefix>.cost_*<format>,
+  // raw floats in the float formats and a heatmap in the .png
+  renderer.output_cost_ = false;
+  renderer.checkpoint_interval_ = 0.0f;
+  // render animation_frames_ frames of the keyframed scene at animation_fps_,
+  // frame_samples_ samples per pixel each, to <prefix><frame><format>;
+  // 0 keeps the progressive mode
+  renderer.animation_frames_ = 0;
+  renderer.animation_fps_ = 24.0f;
+  renderer.frame_samples_ = 16;
+  // room layout: a fixed seed gives the same room every run, 0 a new random one
+  renderer.seed_ = 0;
+  // compiled scene and BVHs are saved to this file and mapped on the next
+  // start instead of being rebuilt, keyed on the seed; empty, or seed 0,
+  // always builds the scene
+  renderer.scene_cache_ = "";
+  // out-of-core poster mode for resolutions that do not fit in memory (use
+  // the headless platform): renders tile by tile, tile_samples_ per pixel,
+  // into a file backed film holding resident_tiles_ tiles in memory, then
+  // writes <prefix>.pfm and <prefix>.ppm; empty keeps the progressive mode
+  renderer.tiled_film_path_ = "";
+  renderer.tile_size_ = 64;
+  renderer.resident_tiles_ = 16;
+  renderer.tile_samples_ = 16;
+  // local render service: accepts jobs (scene seed, mode, resolution, spp or
+  // time budget, output) on 127.0.0.1:<port> and keeps the compiled scenes of
+  // the last warm_scenes_ seeds; try `nc 127.0.0.1 <port>` and "submit
+  // seed=7 spp=8 output=a.png". 0 keeps the progressive mode
+  renderer.server_port_ = 0;
+  renderer.warm_scenes_ = 4;
+  
+  renderer.Init("Visual Computing", 800, 600,MonteCarlo,Wavefront,SortRays);
   renderer.MainLoop();
   renderer.Destroy();
   return 0;
@@ -0,0 +1,53 @@
+#include <spdlog/spdlog.h>
+
+#include <csignal>
+
+#include "graphics/platform.h"
+#include "renderer/renderer.h"
+
+namespace VCL {
+// Window-less platform for servers: nothing is displayed, frames only leave
+// the process through the stream and image outputs. SIGINT/SIGTERM close it.
+class HeadlessWindow : public VWindow {
+ public:
+  virtual void Init(const std::string& title, int& width, int& height,
+                    void* renderer);
+  virtual void Destroy();
+  virtual void DrawBuffer(Framebuffer* buffer);
+};
+
+static HeadlessWindow* g_window = nullptr;
+
+static void HandleSignal(int) {
+  if (g_window) g_window->should_close_ = true;
+}
+
+void InitPlatform() {
+  std::signal(SIGINT, HandleSignal);
+  std::signal(SIGTERM, HandleSignal);
+}
+
+void DestroyPlatform() {
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+}
+
+void PollInputEvents() {}
+
+VWindow* CreateVWindow(const std::string& title, int& width, int& height,
+                       void* renderer) {
+  HeadlessWindow* window = new HeadlessWindow;
+  window->Init(title, width, height, renderer);
+  g_window = window;
+  return window;
+}
+
+void HeadlessWindow::Init(const std::string& title, int& width, int& height,
+                          void* /*renderer*/) {
+  spdlog::info("{}: running headless at {}x{}", title, width, height);
+}
+
+void HeadlessWindow::Destroy() { g_window = nullptr; }
+
+void HeadlessWindow::DrawBuffer(Framebuffer* /*buffer*/) {}
+}  // namespace VCL
@@ -0,0 +1,23 @@
+#include "common/alloccheck.h"
+
+// replaces the global allocator of the app so the AllocFree checks of the
+// library see its allocations; not part of SoftRenderCore
+#ifndef NDEBUG
+#include <cstdlib>
+#include <new>
+
+// the array and nothrow forms end up here as well
+void *operator new(std::size_t size) {
+  VCL::CountAllocation();
+  for (;;) {
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    const std::new_handler handler = std::get_new_handler();
+    if (!handler) throw std::bad_alloc();
+    handler();
+  }
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+#endif
@@ -0,0 +1,63 @@
+#include "imagewriter.h"
+
+#include <spdlog/spdlog.h>
+
+#include "graphics/imageio.h"
+
+namespace VCL {
+ImageWriter::ImageWriter(size_t capacity) : capacity_(capacity) {
+  thread_ = std::thread(&ImageWriter::Run, this);
+}
+
+ImageWriter::~ImageWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+bool ImageWriter::Submit(ImageJob&& job, bool wait) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (wait) idle_cv_.wait(lock, [this] { return queue_.size() < capacity_; });
+    if (queue_.size() >= capacity_) {
+      spdlog::warn("image writer: queue full, dropping {}", job.path_);
+      return false;
+    }
+    queue_.push_back(std::move(job));
+  }
+  cv_.notify_one();
+  return true;
+}
+
+void ImageWriter::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+void ImageWriter::Run() {
+  while (true) {
+    ImageJob job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      busy_ = false;
+      idle_cv_.notify_all();
+      cv_.wait(lock, [this] { return !queue_.empty() || stop_; });
+      if (queue_.empty()) return;  // stopping and drained
+      job = std::move(queue_.front());
+      queue_.pop_front();
+      busy_ = true;
+    }
+    idle_cv_.notify_all();
+    const bool ok = job.ldr_.empty()
+                        ? WriteFloatImage(job.path_, job.width_, job.height_, job.channels_, job.hdr_.data())
+                        : WritePNG(job.path_, job.width_, job.height_, job.channels_, job.ldr_.data());
+    if (ok)
+      spdlog::debug("image writer: wrote {}", job.path_);
+    else
+      spdlog::error("image writer: failed to write {}", job.path_);
+  }
+}
+}  // namespace VCL
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace VCL {
+// one file to write; rows bottom-up, float pixels for .pfm/.hdr/.exr,
+// 8-bit pixels for .png
+struct ImageJob {
+  std::string path_;
+  int width_ = 0;
+  int height_ = 0;
+  int channels_ = 3;
+  std::vector<float> hdr_;
+  std::vector<unsigned char> ldr_;
+};
+
+// Writes images on a background thread. The queue is bounded: when it is
+// full Submit drops the job and returns false instead of waiting, so the
+// render loop is never held up by disk I/O. Final outputs pass wait = true.
+class ImageWriter {
+ public:
+  explicit ImageWriter(size_t capacity = 16);
+  ~ImageWriter();  // writes whatever is still queued
+
+  bool Submit(ImageJob&& job, bool wait = false);
+  void Flush();  // blocks until the queue is empty
+
+ private:
+  void Run();
+
+  const size_t capacity_;
+  std::deque<ImageJob> queue_;
+  bool busy_ = false;
+  bool stop_ = false;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable idle_cv_;  // signalled whenever a job is taken
+  std::thread thread_;
+};
+}  // namespace VCL
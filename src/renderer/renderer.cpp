@@ -1,143 +1,91 @@
 #include "renderer.h"
 
+#include "common/alloccheck.h"
 #include "common/helperfunc.h"
 #include "graphics/globillum.h"
+#include "graphics/reprojection.h"
+#include "graphics/room.h"
+#include "graphics/scenecache.h"
+#include "renderer/renderserver.h"
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 
 namespace VCL {
-void Renderer::Init(const std::string& title, int width, int height,const bool MonteCarlo) {
+void Renderer::Init(const std::string& title, int width, int height,const bool MonteCarlo,
+                    const bool WavefrontMode, const bool SortRays) {
   width_ = width;
   height_ = height;
   MonteCarlo_ = MonteCarlo;
+  // before the window, which may already log to stdout
+  if (!stream_target_.empty() && tiled_film_path_.empty())
+    streamer_ = new FrameStreamer(stream_target_, stream_format_, width_, height_);
   InitPlatform();
   window_ = CreateVWindow(title, width_, height_, this);
-  framebuffer_ = new Framebuffer(width_, height_);
+  if (!tiled_film_path_.empty()) {
+    // the whole-image buffers are what the tiled film replaces
+    tiled_film_ = new TiledFilm(tiled_film_path_, width_, height_, tile_size_, resident_tiles_);
+    if (!tiled_film_->Ok()) spdlog::error("tiled film: cannot create {}", tiled_film_path_);
+  }
+  else {
+    framebuffer_ = new Framebuffer(width_, height_);
+    film_ = new Film(width_, height_);
+    if (!output_prefix_.empty()) {
+      image_writer_ = new ImageWriter;
+      if (output_aovs_) film_->EnableAovs();
+      if (output_cost_) film_->EnableCost();
+    }
+  }
   
   camera_ = new Camera;
-  const float c_y = 1.5;
-  const float c_z = 1.5 + 1.5 * std::sqrt(2);
-  camera_->InitData((float)width_ / height_, 0.25f * PI_, 1.0f, 1000.0f, c_z,
-                    0.0f, 0.5f * PI_, Vec3f(0, c_y, 0));
-
-  auto &mats = scene_.mats_;
-	auto &objs = scene_.objs_;
-  auto &lights = scene_.lights_;
-	// Initialize materials.
-	mats["ceiling"] = std::make_unique<Material>(Color(280, 10, 10)/255.0);
-	mats["floor"] = std::make_unique<Material>(Color(0,255,127)/255.0);
-	mats["front"] = std::make_unique<Material>(Color(0.3, 0.8, 0.8));
-  mats["end"] = std::make_unique<Material>(Color(0.8, 0.8, 0.3));
-	mats["side"] = std::make_unique<Material>(Color(0, 0.1, 1));//blue
-
-  if (MonteCarlo_){
-    mats["mirror"] = std::make_unique<Material>(Color(37.2f, 24.4f, 13.2f) / 255, Color(.6f, .6f, .6f), -1);
-    mats["yellow_light"] = std::make_unique<Material>(Color(1, 1, 0.5), true);
+  RoomView(*camera_, (float)width_ / height_);
+
+  // the room only depends on its version, the integrator mode and the seed;
+  // seed 0 is a new random layout every run, which no cache can hold
+  const auto load_start = std::chrono::steady_clock::now();
+  const bool cached = !scene_cache_.empty() && seed_ != 0;
+  uint64_t source = SceneCache::Hash(&kRoomVersion, sizeof(kRoomVersion));
+  source = SceneCache::Hash(&MonteCarlo_, sizeof(MonteCarlo_), source);
+  source = SceneCache::Hash(&seed_, sizeof(seed_), source);
+  if (cached && SceneCache::Load(scene_, scene_cache_, source)) {
+    const auto load_end = std::chrono::steady_clock::now();
+    spdlog::info("scene: loaded {} in {:.2f} ms", scene_cache_,
+                 std::chrono::duration<float, std::milli>(load_end - load_start).count());
   }
   else {
-    mats["mirror"] = std::make_unique<Material>(Color(0, 0, 0) , Color(1.6f, 1.6f, 1.6f), 30);
-    mats["yellow_light"] = std::make_unique<Material>(Color(10, 10, 5), true);
-  }
-	mats["light"] = std::make_unique<Material>(Color(20, 20, 20), true);
-  mats["small_light"] = std::make_unique<Material>(Color(3, 3, 3), true);
- 
-
-  mats["metal"] = std::make_unique<Material>(Color(0, 0, 0), Color(.8f, .8f, .8f), 30);
-  if (MonteCarlo_)
-    mats["lampo"] = std::make_unique<Material>(Color(0.8, 0.8, 0));
-  else
-    mats["lampo"] = std::make_unique<Material>(Color(1.8, 1.8, 0));
-  mats["lampi"] = std::make_unique<Material>(Color(0.1, 0.1, 0));
-  mats["stick"] = std::make_unique<Material>(Color(1.8, 1.8, 0.1));
-  mats["cube"] = std::make_unique<Material>(Color(0, 0, 0.5),Color(.01f, .01f, .01f), 0);
-
-	// Set boundaries.
-	objs.emplace_back(std::make_unique<Plane>(
-		mats["ceiling"].get(),
-		Vec3(0, 3, 0), Vec3(0, -1, 0)));
-	objs.emplace_back(std::make_unique<Plane>(
-		mats["floor"].get(),
-		Vec3(0, 0, 0), Vec3(0, 1, 0)));
-	objs.emplace_back(std::make_unique<Plane>(
-		mats["front"].get(),
-		Vec3(0, 0, -4), Vec3(0, 0, 1)));
-  objs.emplace_back(std::make_unique<Plane>(
-		mats["end"].get(),
-		Vec3(0, 0, 0), Vec3(0, 0, -1)));
-	objs.emplace_back(std::make_unique<Plane>(//left
-		mats["side"].get(),
-		Vec3(-2, 0, 0), Vec3(1, 0, 0)));
-	objs.emplace_back(std::make_unique<Plane>(//right
-		mats["mirror"].get(),
-		Vec3(2, 0, 0), Vec3(-1, 0, 0)));
- 
-	// Set the light.
-  //---random---
-  Vec3 dotlight1 = Vec3(0.8+0.2*rand_01() ,1.6+0.2*rand_01(),-4);
-  Vec3 dotlight2 = Vec3(-dotlight1[0], dotlight1[1],dotlight1[2]);
-  //---random---
-	const real dl = real(2) / 3;
-	const real rl = 10;
-	const real hl = std::sqrt(rl * rl - dl * dl);
-  const real dl2 = 0.02;
-	const real rl2 = 0.1;
-	const real hl2 = std::sqrt(rl2 * rl2 - dl2 * dl2);
-
-  objs.emplace_back(std::make_unique<Sphere>( mats["light"].get(),Vec3(0, 3 + hl, -2), rl));
-  lights.emplace_back(std::make_unique<Light>(Vec3(0, 3, -2),Color(1, 1, 1) * 2.0));
-  
-  objs.emplace_back(std::make_unique<Sphere>( mats["small_light"].get(), dotlight1 + Vec3( 0, 0, - hl2), rl2));
-  lights.emplace_back(std::make_unique<Light>(dotlight1, Color(1, 1, 1) * 2.0));
-  
-  objs.emplace_back(std::make_unique<Sphere>( mats["small_light"].get(), dotlight2 + Vec3( 0, 0, - hl2), rl2));
-  lights.emplace_back(std::make_unique<Light>(dotlight2, Color(1, 1, 1) * 2.0));
-  
-  // Set internal objects.
-  //---random---
-  real tmpz = rand_01();
-  real ball_rad = 0.4 + 0.2 * rand_01();
-  Vec3 ball ;
-  Vec3 cube_;
-
-  if(tmpz < 0.33){
-    ball = Vec3(0, ball_rad, -3);
-    cube_ = Vec3(-1, real(0.8), -1);
-  }
-  else if (tmpz < 0.67){
-    ball = Vec3(0, ball_rad, -1.2);
-    cube_ = Vec3(-0.2, real(0.8), -3);
-  }
-  else{
-    ball = Vec3(1.35, ball_rad, -2.5);
-    cube_ = Vec3(-1, real(0.8), -2);
-  }
-  //std::cout<<tmpz<<std::endl;
-  //std::cout<<ball_rad<<std::endl;
-  //---random---
-
-  objs.emplace_back(std::make_unique<Cube>(mats["cube"].get(), cube_, real(.6),real(1.6),real(.8)));
-  objs.emplace_back(std::make_unique<Sphere>( mats["metal"].get(), ball, ball_rad));
-
-  // lamp position
-  //---random---
-  Vec3 lamp_o = Vec3(1.35+0.05*rand_01(), real(1.5), -1.2-0.1*rand_01());
-  //---random---
-  Vec3f lamp_p = lamp_o + Vec3(0, -0.25, 0);
-  Vec3f lamp_c = Vec3(lamp_o[0], 0.58,lamp_o[2] );
-  Vec3f lamp_d = Vec3(lamp_o[0], 0.025,lamp_o[2] );
-
-  objs.emplace_back(std::make_unique<CapeOutside>(mats["lampo"].get(),lamp_o, real(.5)));
-  objs.emplace_back(std::make_unique<CapeInside>(mats["lampi"].get(), lamp_o+Vec3(0, -0.01, 0), real(.5)));
-
-  objs.emplace_back(std::make_unique<Sphere>( mats["yellow_light"].get(), lamp_p , real(.15)));
-  lights.emplace_back(std::make_unique<Light>( lamp_p  , Color(1, 1, 0) * 0.35));
-
-  objs.emplace_back(std::make_unique<Cube>( mats["stick"].get(), lamp_c , real(0.05),real(1.06),real(0.05)));
-  objs.emplace_back(std::make_unique<Cube>( mats["stick"].get(), lamp_d , real(0.4),real(0.05),real(0.4)));
-  
-  scene_.ambient_light_ = Color(0.05, 0.05, 0.05);
+    BuildRoom(scene_, MonteCarlo_, seed_);
+    scene_.Compile();
+    if (cached) {
+      if (SceneCache::Save(scene_, scene_cache_, source)) spdlog::info("scene: cached to {}", scene_cache_);
+      else spdlog::warn("scene: cannot write {}", scene_cache_);
+    }
+  }
+  kernel_ = GlobIllum::SelectKernel(MonteCarlo_, kernel_features_);
+  if (!MonteCarlo_ && (kernel_features_ & GlobIllum::IRRADIANCE_CACHE)) {
+    irradiance_cache_ = new IrradianceCache(irradiance_cell_);
+    scene_.irradiance_ = irradiance_cache_;
+  }
+  if (MonteCarlo_ && (kernel_features_ & GlobIllum::GUIDING)) {
+    path_guide_ = new PathGuide(guide_cell_);
+    scene_.guide_ = path_guide_;
+  }
+  if (MonteCarlo_ && (kernel_features_ & GlobIllum::CAUSTICS)) {
+    photon_map_ = new PhotonMap(caustic_radius_);
+    scene_.caustics_ = photon_map_;
+  }
+  // tiles resample without reuse, a whole-image buffer is what they avoid
+  if ((kernel_features_ & GlobIllum::RESAMPLED_DIRECT) && !tiled_film_)
+    reservoirs_ = new ReservoirBuffer(width_, height_);
+
+  if (WavefrontMode)
+    wavefront_ = new Wavefront(scene_, MonteCarlo_, SortRays, kernel_features_ & GlobIllum::FAST_MATH);
+  scene_versions_ = new SceneVersions(scene_);
 }
 
-void Renderer::Progress(int &x, int &y, Color **buffer, int **cnt) {
+void Renderer::Progress(const Scene &scene, int &x, int &y) {
+  AllocFree alloc_free;
   const real dx = real(1) / width_;
 	const real dy = real(1) / height_;
 
@@ -147,16 +95,25 @@ void Renderer::Progress(int &x, int &y, Color **buffer, int **cnt) {
   const real sx = lx + rand01() * dx;
   const real sy = ly + rand01() * dy;
 
-  if (!MonteCarlo_) {
-    buffer[y][x] += (GlobIllum::RayTrace(scene_, camera_->GenerateRay(sx, sy)) - buffer[y][x]) / (++cnt[y][x]);    
+  Aov aov;
+  Aov *paov = film_->aov_ ? &aov : nullptr;
+  Cost cost;
+  std::chrono::steady_clock::time_point start;
+  if (film_->cost_) {
+    g_cost = &cost;
+    start = std::chrono::steady_clock::now();
   }
-  else {
-    buffer[y][x] += (GlobIllum::PathTrace(scene_, camera_->GenerateRay(sx, sy)) - buffer[y][x]) / (++cnt[y][x]);
+  g_reservoir_pixel = {reservoirs_, x, y};
+  const Color color = kernel_(scene, camera_->GenerateRay(sx, sy), paov);
+  g_reservoir_pixel = ReservoirPixel();  // the buffer dies with the Renderer, the pool thread does not
+  if (paov) film_->AddSample(x, y, color, aov);
+  else film_->AddSample(x, y, color);
+  if (film_->cost_) {
+    cost.ns_ = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - start).count();
+    g_cost = nullptr;
+    film_->AddCost(x, y, cost);
   }
 
-  int idx = (y * width_ + x) * 4;
-  for (int i = 0; i < 3; i++) framebuffer_->color_[idx + i] = std::round(std::pow(std::clamp(buffer[y][x][i], 0.0f, 1.0f), 1 / 2.2f) * 255);
-
   x++;
   if (x == width_) {
     x = 0;
@@ -166,53 +123,310 @@ void Renderer::Progress(int &x, int &y, Color **buffer, int **cnt) {
 }
 
 void Renderer::MainLoop() {
-
-  int x;
-  int y;
-
-  Color **buffer = new Color *[height_];
-  int **cnt = new int *[height_];
-
-  for (y = 0; y < height_; y++) {
-    buffer[y] = new Color[width_];
-    cnt[y] = new int[width_];
-    for (x = 0; x < width_; x++) {
-      buffer[y][x] = Color::Zero();
-      cnt[y][x] = 0;
-    }
+  if (server_port_ > 0) {
+    RenderServer server(*this, server_port_, warm_scenes_);
+    server.Run();
+    return;
+  }
+  if (tiled_film_) {
+    RenderTiles();
+    return;
   }
 
-  x = y = 0;
+  film_->Clear();
+
   int idx = 0;
   const int buffer_size = height_ * width_;
   int patch_size = 50000;
   patch_size = patch_size > buffer_size ? buffer_size : patch_size;
+  std::vector<int> pixels(wavefront_ ? patch_size : 0);
+  std::vector<Color> colors(wavefront_ ? patch_size : 0);
+  std::vector<Aov> aovs(wavefront_ && film_->aov_ ? patch_size : 0);
+  if (wavefront_) wavefront_->Reserve(patch_size);
+  auto last_stream = std::chrono::steady_clock::now();
+  auto last_checkpoint = last_stream;
+
+  // frame sequence: every frame gets exactly frame_samples_ samples per pixel
+  const bool sequence = animation_frames_ > 0;
+  const long long frame_pixels = (long long)frame_samples_ * buffer_size;
+  long long remaining = frame_pixels;
+  int frame = 0;
+  if (sequence) scene_versions_->Edit([](Scene &scene) { scene.Animate(0); });
+  Camera view = *camera_;  // what the film holds
+  uint64_t version = 0;    // of the scene the film holds
+
   while (!window_->should_close_) {
     PollInputEvents();
+    // the pass renders the newest scene version and nothing else; the
+    // samples of older versions are dropped, of a frame as well
+    uint64_t pinned;
+    const Scene &scene = scene_versions_->Pin(pinned);
+    if (pinned != version) {
+      film_->Clear();
+      if (photon_map_) photon_map_->Reset();
+      if (irradiance_cache_) irradiance_cache_->Clear();
+      if (path_guide_) path_guide_->Clear();
+      if (reservoirs_) reservoirs_->Clear();
+      if (wavefront_) wavefront_->SetScene(scene);
+      remaining = frame_pixels;
+      idx = 0;
+      view = *camera_;
+      version = pinned;
+    }
+    else if (!camera_->SameView(view)) {
+      // the samples belong to the old view: carry them over, or start again
+      if (reproject_ && film_->aov_) {
+        const int kept = Reproject(*film_, view, *camera_, scene, reproject_history_);
+        spdlog::debug("reprojection kept {:.1f}% of the pixels", 100.0f * kept / buffer_size);
+      }
+      else {
+        film_->Clear();
+        // the depth reprojection needs is only recorded once the camera moves
+        if (reproject_) {
+          film_->EnableAovs();
+          if (wavefront_) aovs.resize(patch_size);
+        }
+      }
+      if (reservoirs_) reservoirs_->Clear();
+      view = *camera_;
+    }
 
-    // parallel version
-    # pragma omp parallel for
-    for (int i = 0; i < patch_size; ++i) {
-      int p = (idx + i) % buffer_size;
-      int px = p % width_;
-      int py = p / width_;
-      Progress(px, py, buffer, cnt);
+    const int count = sequence ? int(std::min<long long>(patch_size, remaining)) : patch_size;
+    // one photon pass per patch, the gather radius shrinks with every pass
+    if (photon_map_) photon_map_->Emit(scene, caustic_photons_);
+    // room for what the samples record, nothing is allocated while they run
+    if (irradiance_cache_) irradiance_cache_->Reserve(count);
+    if (path_guide_) path_guide_->Reserve(count);
+    if (wavefront_) {
+      // the whole patch is one wavefront batch
+      for (int i = 0; i < count; ++i) pixels[i] = (idx + i) % buffer_size;
+      // counts this thread only, every stage opens its own scope on the workers
+      AllocFree alloc_free;
+      wavefront_->Render(*camera_, width_, height_, pixels.data(), count, colors.data(),
+                         aovs.empty() ? nullptr : aovs.data());
+      # pragma omp parallel for
+      for (int i = 0; i < count; ++i) {
+        AllocFree alloc_free;
+        if (aovs.empty()) film_->AddSample(pixels[i] % width_, pixels[i] / width_, colors[i]);
+        else film_->AddSample(pixels[i] % width_, pixels[i] / width_, colors[i], aovs[i]);
+      }
     }
-    idx = (idx + patch_size) % buffer_size;
+    else {
+      // parallel version
+      # pragma omp parallel for
+      for (int i = 0; i < count; ++i) {
+        int p = (idx + i) % buffer_size;
+        int px = p % width_;
+        int py = p / width_;
+        Progress(scene, px, py);
+      }
+    }
+    CheckAllocFree("a render pass");
+    // the reservoirs of a whole pass over the image are reused by the next one
+    if (reservoirs_ && idx + count >= buffer_size) reservoirs_->Swap();
+    idx = (idx + count) % buffer_size;
+    // samples recorded during the patch become visible to the next one
+    if (irradiance_cache_) irradiance_cache_->Commit();
+    if (path_guide_) path_guide_->Commit();
 
+    // tonemapping only happens for the frames that are actually shown
+    Resolve(*film_, framebuffer_, tonemapper_);
     window_->DrawBuffer(framebuffer_);
+
+    if (streamer_) {
+      const auto now = std::chrono::steady_clock::now();
+      if (std::chrono::duration<float>(now - last_stream).count() >= stream_interval_) {
+        streamer_->Publish(*framebuffer_);
+        last_stream = now;
+      }
+    }
+
+    if (sequence) {
+      remaining -= count;
+      if (remaining > 0) continue;
+      spdlog::info("frame {} / {} done", frame + 1, animation_frames_);
+      if (image_writer_) WriteImages(true, frame);
+      if (++frame == animation_frames_) break;
+      // the next pass starts the frame on the new version
+      const real time = frame / animation_fps_;
+      scene_versions_->Edit([time](Scene &scene) { scene.Animate(time); });
+      continue;
+    }
+
+    if (image_writer_ && checkpoint_interval_ > 0) {
+      const auto now = std::chrono::steady_clock::now();
+      if (std::chrono::duration<float>(now - last_checkpoint).count() >= checkpoint_interval_) {
+        WriteImages(false);
+        last_checkpoint = now;
+      }
+    }
   }
 
-  for (y = 0; y < height_; y++) {
-    delete[] buffer[y];
-    delete[] cnt[y];
+  scene_versions_->Unpin();
+  if (image_writer_ && !sequence) WriteImages(true);
+}
+
+void Renderer::RenderTiles() {
+  if (!tiled_film_->Ok()) return;
+  const int tiles = tiled_film_->TilesX() * tiled_film_->TilesY();
+  const int batch = 50000;  // wavefront batch, as in MainLoop
+  std::vector<int> pixels(wavefront_ ? batch : 0);
+  std::vector<Color> colors(wavefront_ ? batch : 0);
+  if (wavefront_) wavefront_->Reserve(batch);
+  const real dx = real(1) / width_;
+  const real dy = real(1) / height_;
+  auto start = std::chrono::steady_clock::now();
+  auto last_report = start;
+
+  // the whole poster is one scene version, edits made meanwhile wait for the next render
+  uint64_t version;
+  const Scene &scene = scene_versions_->Pin(version);
+  if (wavefront_) wavefront_->SetScene(scene);
+  // one photon pass for the whole image
+  if (photon_map_) photon_map_->Emit(scene, caustic_photons_);
+  int done = 0;
+  for (; done < tiles && !window_->should_close_; ++done) {
+    PollInputEvents();
+    TiledFilm::Tile& tile = tiled_film_->Acquire(done % tiled_film_->TilesX(), done / tiled_film_->TilesX());
+    const int count = tile.width_ * tile.height_;
+    if (irradiance_cache_) irradiance_cache_->Reserve(count * tile_samples_);
+    if (path_guide_) path_guide_->Reserve(count * tile_samples_);
+    if (wavefront_) {
+      // every sample of the tile, pixel-major, in batches
+      const long long total = (long long)count * tile_samples_;
+      for (long long first = 0; first < total; first += batch) {
+        const int n = int(std::min<long long>(batch, total - first));
+        for (int i = 0; i < n; ++i) {
+          const int p = int((first + i) / tile_samples_);
+          pixels[i] = (tile.y0_ + p / tile.width_) * width_ + tile.x0_ + p % tile.width_;
+        }
+        AllocFree alloc_free;
+        wavefront_->Render(*camera_, width_, height_, pixels.data(), n, colors.data(), nullptr);
+        // Tile::AddSample is not synchronized; Render traced in parallel, this
+        // loop accumulates on one thread, which is what keeps it safe
+        for (int i = 0; i < n; ++i) tile.AddSample(pixels[i] % width_, pixels[i] / width_, colors[i], tile_size_);
+      }
+    }
+    else {
+      # pragma omp parallel for schedule(dynamic, 16)
+      for (int p = 0; p < count; ++p) {
+        AllocFree alloc_free;
+        const int x = tile.x0_ + p % tile.width_;
+        const int y = tile.y0_ + p / tile.width_;
+        for (int s = 0; s < tile_samples_; ++s)
+          tile.AddSample(x, y, kernel_(scene, camera_->GenerateRay(dx * (x + rand01()), dy * (y + rand01())), nullptr),
+                         tile_size_);
+      }
+    }
+    CheckAllocFree("a render pass");
+    if (irradiance_cache_) irradiance_cache_->Commit();
+    if (path_guide_) path_guide_->Commit();
+    const auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<float>(now - last_report).count() >= 5.0f) {
+      spdlog::info("tile {} / {}", done + 1, tiles);
+      last_report = now;
+    }
+  }
+  scene_versions_->Unpin();
+  spdlog::info("{} / {} tiles in {:.1f} s", done, tiles,
+               std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count());
+  if (output_prefix_.empty()) return;
+  if (!tiled_film_->WritePFM(output_prefix_ + ".pfm")) spdlog::error("tiled film: failed to write {}.pfm", output_prefix_);
+  if (!tiled_film_->WritePPM(output_prefix_ + ".ppm", tonemapper_))
+    spdlog::error("tiled film: failed to write {}.ppm", output_prefix_);
+}
+
+void Renderer::WriteImages(bool final, int frame) {
+  // snapshot now, encoding and disk I/O happen on the writer thread;
+  // checkpoints are dropped if the writer falls behind, the final images are not
+  const int size = width_ * height_;
+  std::string prefix = output_prefix_;
+  if (frame >= 0) {
+    char number[16];
+    std::snprintf(number, sizeof(number), "%04d", frame);
+    prefix += number;
+  }
+  // per-pixel cost, one image per counter
+  static const std::pair<const char *, float Cost::*> cost_fields[] = {
+    {".cost_ns", &Cost::ns_}, {".cost_tests", &Cost::tests_},
+    {".cost_bounces", &Cost::bounces_}, {".cost_shadow", &Cost::shadow_rays_}};
+  auto cost_values = [this, size](float Cost::*field) {
+    std::vector<float> values(size);
+    for (int i = 0; i < size; i++) values[i] = film_->cost_[i].*field;
+    return values;
+  };
+  if (final && film_->cost_) {
+    double ns = 0, tests = 0;
+    for (int i = 0; i < size; i++) {
+      ns += film_->cost_[i].ns_;
+      tests += film_->cost_[i].tests_;
+    }
+    spdlog::info("cost: {:.0f} ns and {:.1f} intersection tests per sample", ns / size, tests / size);
+  }
+  auto submit = [this, final](const std::string &path, int channels, std::vector<float> &&pixels) {
+    ImageJob job;
+    job.path_ = path;
+    job.width_ = width_;
+    job.height_ = height_;
+    job.channels_ = channels;
+    job.hdr_ = std::move(pixels);
+    image_writer_->Submit(std::move(job), final);
+  };
+  for (const auto &format : output_formats_) {
+    if (format == ".png") {
+      ImageJob job;
+      job.path_ = prefix + format;
+      job.width_ = width_;
+      job.height_ = height_;
+      job.channels_ = 3;
+      job.ldr_.resize(size_t(size) * 3);
+      for (int i = 0; i < size; i++)
+        for (int k = 0; k < 3; k++) job.ldr_[3 * i + k] = framebuffer_->color_[4 * i + k];
+      image_writer_->Submit(std::move(job), final);
+      if (!film_->cost_) continue;
+      for (const auto &[name, field] : cost_fields) {
+        ImageJob heat;
+        heat.path_ = prefix + name + format;
+        heat.width_ = width_;
+        heat.height_ = height_;
+        heat.channels_ = 3;
+        heat.ldr_.resize(size_t(size) * 3);
+        FalseColor(cost_values(field).data(), size, heat.ldr_.data());
+        image_writer_->Submit(std::move(heat), final);
+      }
+      continue;
+    }
+    const float *color = film_->color_[0].data();
+    submit(prefix + format, 3, std::vector<float>(color, color + 3 * size));
+    if (film_->cost_)
+      for (const auto &[name, field] : cost_fields) submit(prefix + name + format, 1, cost_values(field));
+    if (!output_aovs_ || !film_->aov_) continue;
+    std::vector<float> albedo(3 * size), normal(3 * size), depth(size);
+    for (int i = 0; i < size; i++) {
+      for (int k = 0; k < 3; k++) {
+        albedo[3 * i + k] = film_->aov_[i].albedo_[k];
+        normal[3 * i + k] = film_->aov_[i].normal_[k];
+      }
+      depth[i] = film_->aov_[i].depth_;
+    }
+    submit(prefix + ".albedo" + format, 3, std::move(albedo));
+    submit(prefix + ".normal" + format, 3, std::move(normal));
+    submit(prefix + ".depth" + format, 1, std::move(depth));
   }
-  delete[] buffer;
-  delete[] cnt;
 }
 
 void Renderer::Destroy() {
+  if (image_writer_) delete image_writer_;
+  if (streamer_) delete streamer_;
+  if (wavefront_) delete wavefront_;
+  if (scene_versions_) delete scene_versions_;
+  if (photon_map_) delete photon_map_;
+  if (irradiance_cache_) delete irradiance_cache_;
+  if (path_guide_) delete path_guide_;
+  if (reservoirs_) delete reservoirs_;
   if (camera_) delete camera_;
+  if (film_) delete film_;
+  if (tiled_film_) delete tiled_film_;
   if (framebuffer_) delete framebuffer_;
   window_->Destroy();
   if (window_) delete window_;
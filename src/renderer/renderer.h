@@ -4,9 +4,21 @@
 #include <vector>
 
 #include "graphics/camera.h"
+#include "graphics/film.h"
+#include "graphics/globillum.h"
 #include "graphics/framebuffer.h"
+#include "graphics/irradiancecache.h"
+#include "graphics/pathguide.h"
+#include "graphics/photonmap.h"
 #include "graphics/platform.h"
+#include "graphics/reservoir.h"
 #include "graphics/scene.h"
+#include "graphics/sceneversions.h"
+#include "graphics/tiledfilm.h"
+#include "graphics/tonemap.h"
+#include "graphics/wavefront.h"
+#include "renderer/imagewriter.h"
+#include "renderer/streamer.h"
 
 namespace VCL {
 enum class BUTTON : unsigned char { Left = 0, Right, Middle, NUM };
@@ -15,9 +27,20 @@ class Renderer {
  public:
   VWindow* window_ = nullptr;
   Framebuffer* framebuffer_ = nullptr;
+  Film* film_ = nullptr;
   Camera* camera_ = nullptr;
 
   Scene scene_;
+  // the versions of scene_ the passes render: edits from any thread go
+  // through scene_versions_->Edit, without stopping MainLoop, and the next
+  // pass starts the image again with them. scene_ is version 0, as built
+  SceneVersions* scene_versions_ = nullptr;
+  // room layout, see BuildRoom; 0 draws a new random one every run
+  uint32_t seed_ = 0;
+  // compiled scene cache, reused while it matches; empty, or seed_ 0, always
+  // builds the scene
+  std::string scene_cache_;
+  Wavefront* wavefront_ = nullptr;
 
   Vec2f last_mouse_pos_;
   bool button_pressed_[size_t(BUTTON::NUM)] = {};
@@ -25,10 +48,68 @@ class Renderer {
   int width_ = 800;
   int height_ = 600;
   bool MonteCarlo_;
+  // GlobIllum::KernelFeature flags, the kernel is picked once in Init
+  unsigned kernel_features_ = GlobIllum::SHADOW_RAYS | GlobIllum::SPECULAR;
+  GlobIllum::Kernel kernel_ = nullptr;
+  // GlobIllum::CAUSTICS: photons per pass and initial gather radius
+  PhotonMap* photon_map_ = nullptr;
+  int caustic_photons_ = 100000;
+  float caustic_radius_ = 0.05f;
+  // GlobIllum::IRRADIANCE_CACHE: grid cell size of the cache
+  IrradianceCache* irradiance_cache_ = nullptr;
+  float irradiance_cell_ = 0.1f;
+  // GlobIllum::GUIDING: grid cell size of the guide
+  PathGuide* path_guide_ = nullptr;
+  float guide_cell_ = 0.25f;
+  // GlobIllum::RESAMPLED_DIRECT: light reservoirs of the first hits, per pixel
+  ReservoirBuffer* reservoirs_ = nullptr;
+  Tonemapper tonemapper_ = Tonemapper::Clamp;
+  // keep the converged samples when the camera moves, see Reproject; at most
+  // reproject_history_ per pixel survive a move. The depth it needs is only
+  // recorded after the first move, which starts over
+  bool reproject_ = true;
+  int reproject_history_ = 64;
 
-  void Init(const std::string& title, int width, int height, const bool MonteCarlo);
-  void Progress(int &x, int &y, Color **buffer, int **cnt);
+  // progressive frame stream, disabled while stream_target_ is empty
+  FrameStreamer* streamer_ = nullptr;
+  std::string stream_target_;
+  StreamFormat stream_format_ = StreamFormat::Y4M;
+  float stream_interval_ = 1.0f;  // seconds between published frames
+
+  // image output to <output_prefix_><format>, disabled while the prefix is empty
+  ImageWriter* image_writer_ = nullptr;
+  std::string output_prefix_;
+  std::vector<std::string> output_formats_ = {".exr", ".png"};
+  bool output_aovs_ = false;          // albedo, normal and depth next to the beauty pass
+  bool output_cost_ = false;          // per-pixel cost of the samples, see Cost
+  float checkpoint_interval_ = 0.0f;  // seconds, 0 only writes when the loop ends
+
+  // frame sequence of the keyframed scene, disabled while animation_frames_ is 0
+  int animation_frames_ = 0;
+  float animation_fps_ = 24.0f;
+  int frame_samples_ = 16;  // samples per pixel of every frame
+
+  // out-of-core poster render, disabled while tiled_film_path_ is empty:
+  // the image is rendered tile by tile into a tiled film backed by this file
+  // and streamed to <output_prefix_>.pfm/.ppm; nothing is displayed
+  TiledFilm* tiled_film_ = nullptr;
+  std::string tiled_film_path_;
+  int tile_size_ = 64;
+  int resident_tiles_ = 16;
+  int tile_samples_ = 16;  // samples per pixel
+
+  // render job server on 127.0.0.1:<server_port_>, disabled while 0: MainLoop
+  // serves jobs instead of refining the window, see RenderServer
+  int server_port_ = 0;
+  int warm_scenes_ = 4;  // compiled scenes kept between jobs
+
+  void Init(const std::string& title, int width, int height, const bool MonteCarlo,
+            const bool WavefrontMode = false, const bool SortRays = false);
+  void Progress(const Scene &scene, int &x, int &y);
+  // `frame` >= 0 appends the 4-digit frame number to the output prefix
+  void WriteImages(bool final, int frame = -1);
   void MainLoop();
+  void RenderTiles();
   void Destroy();
 
   // callbacks
@@ -0,0 +1,378 @@
+#include "renderserver.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "graphics/imageio.h"
+#include "graphics/room.h"
+#include "renderer/renderer.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <csignal>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace VCL {
+namespace {
+const char* kStateNames[] = {"queued", "running", "done", "failed", "cancelled"};
+const size_t kMaxLine = 4096;
+const size_t kMaxFinished = 256;  // finished jobs kept for status
+
+bool HasExtension(const std::string& path, const char* ext) {
+  const size_t n = std::char_traits<char>::length(ext);
+  return path.size() > n && path.compare(path.size() - n, n, ext) == 0;
+}
+
+float Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+}  // namespace
+
+RenderServer::RenderServer(Renderer& renderer, int port, int warm_scenes)
+    : renderer_(renderer), port_(port), warm_scenes_(std::max(warm_scenes, 1)) {
+#ifndef _WIN32
+  // a client going away must not kill the server
+  std::signal(SIGPIPE, SIG_IGN);
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((unsigned short)port_);
+  if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd_, 8) != 0) {
+    spdlog::error("server: cannot listen on 127.0.0.1:{}", port_);
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return;
+  }
+  spdlog::info("server: listening on 127.0.0.1:{}", port_);
+  thread_ = std::thread(&RenderServer::Listen, this);
+#else
+  spdlog::error("server: not supported on this platform");
+#endif
+}
+
+RenderServer::~RenderServer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  if (thread_.joinable()) thread_.join();
+#ifndef _WIN32
+  for (const Client& client : clients_) close(client.fd_);
+  if (listen_fd_ >= 0) close(listen_fd_);
+#endif
+}
+
+void RenderServer::Run() {
+  if (listen_fd_ < 0) return;
+  while (!renderer_.window_->should_close_) {
+    PollInputEvents();
+    RenderJob* job = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_) break;
+      job = Next();
+      if (job) job->state_ = RenderJob::State::Running;
+    }
+    if (job) Render(*job);
+    else std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+}
+
+RenderJob* RenderServer::Next() {
+  RenderJob* next = nullptr;
+  for (auto& [id, job] : jobs_)
+    if (job.state_ == RenderJob::State::Queued && (!next || job.priority_ > next->priority_)) next = &job;
+  return next;
+}
+
+void RenderServer::Forget() {
+  size_t finished = 0;
+  for (const auto& [id, job] : jobs_) finished += job.state_ >= RenderJob::State::Done;
+  // the oldest ones go first, ids grow with submission
+  for (auto it = jobs_.begin(); finished > kMaxFinished && it != jobs_.end();) {
+    if (it->second.state_ >= RenderJob::State::Done) {
+      it = jobs_.erase(it);
+      --finished;
+    }
+    else {
+      ++it;
+    }
+  }
+}
+
+RenderServer::WarmScene& RenderServer::Acquire(RenderJob& job) {
+  // seed 0 is a new random layout every time, nothing to reuse or keep
+  const bool random = job.seed_ == 0;
+  const auto key = std::make_pair(job.seed_, job.monte_carlo_);
+  auto found = random ? scenes_.end() : scenes_.find(key);
+  if (found != scenes_.end()) {
+    found->second->last_use_ = ++clock_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++scene_hits_;
+    job.warm_ = true;
+    return *found->second;
+  }
+  if (!random && int(scenes_.size()) >= warm_scenes_) {
+    // drop the least recently used scene
+    auto oldest = scenes_.begin();
+    for (auto it = scenes_.begin(); it != scenes_.end(); ++it)
+      if (it->second->last_use_ < oldest->second->last_use_) oldest = it;
+    scenes_.erase(oldest);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  auto warm = std::make_unique<WarmScene>();
+  warm->session_ = std::make_unique<RenderSession>(job.width_, job.height_);
+  RenderSession& session = *warm->session_;
+  BuildRoom(session.scene_, job.monte_carlo_, job.seed_);
+  session.scene_.Compile();
+  // the same integrator as the window
+  IntegratorSettings settings;
+  settings.monte_carlo_ = job.monte_carlo_;
+  settings.kernel_features_ = renderer_.kernel_features_;
+  settings.caustic_photons_ = renderer_.caustic_photons_;
+  settings.caustic_radius_ = renderer_.caustic_radius_;
+  settings.irradiance_cell_ = renderer_.irradiance_cell_;
+  settings.guide_cell_ = renderer_.guide_cell_;
+  session.Configure(settings);
+  warm->last_use_ = ++clock_;
+  const float seconds = Seconds(start);
+  spdlog::info("server: built scene seed {} ({}) in {:.1f} ms", job.seed_, job.monte_carlo_ ? "pt" : "rt",
+               seconds * 1000);
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++scene_misses_;
+  build_seconds_ += seconds;
+  if (random) {
+    random_ = std::move(warm);
+    return *random_;
+  }
+  auto& slot = scenes_[key];
+  slot = std::move(warm);
+  scenes_warm_ = int(scenes_.size());
+  return *slot;
+}
+
+void RenderServer::Render(RenderJob& job) {
+  const auto start = std::chrono::steady_clock::now();
+  RenderSession& session = *Acquire(job).session_;
+  if (session.Width() != job.width_ || session.Height() != job.height_)
+    session.SetResolution(job.width_, job.height_);
+  // the gather radius starts over, the learned caches are kept
+  session.Clear();
+  const int spp = job.spp_ == 0 && job.seconds_ == 0 ? 16 : job.spp_;
+
+  bool cancelled = false;
+  int samples = 0;
+  while (spp == 0 || samples < spp) {
+    if (job.seconds_ > 0 && Seconds(start) >= job.seconds_) break;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cancelled = job.cancel_ || stop_;
+    }
+    cancelled |= renderer_.window_->should_close_;
+    if (cancelled) break;
+
+    samples += session.Render(1);
+    PollInputEvents();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    job.samples_ = samples;
+    job.elapsed_ = Seconds(start);
+  }
+
+  std::string error;
+  const int size = job.width_ * job.height_;
+  if (!cancelled) {
+    bool ok;
+    if (HasExtension(job.output_, ".png")) {
+      std::vector<unsigned char> ldr(size_t(size) * 3);
+      session.ReadPixels(ldr.data(), 3, renderer_.tonemapper_);
+      ok = WritePNG(job.output_, job.width_, job.height_, 3, ldr.data());
+    }
+    else {
+      std::vector<float> hdr(size_t(size) * 3);
+      session.ReadPixels(hdr.data());
+      ok = WriteFloatImage(job.output_, job.width_, job.height_, 3, hdr.data());
+    }
+    if (!ok) error = "cannot write " + job.output_;
+  }
+
+  const float seconds = Seconds(start);
+  std::lock_guard<std::mutex> lock(mutex_);
+  job.elapsed_ = seconds;
+  job.error_ = error;
+  job.state_ = cancelled ? RenderJob::State::Cancelled
+                         : error.empty() ? RenderJob::State::Done : RenderJob::State::Failed;
+  samples_ += (long long)samples * size;
+  render_seconds_ += seconds;
+  spdlog::info("server: job {} {} after {} spp in {:.2f} s", job.id_, kStateNames[int(job.state_)], samples,
+               seconds);
+  Forget();  // job is not used after this
+}
+
+void RenderServer::Listen() {
+#ifndef _WIN32
+  std::vector<pollfd> fds;
+  char buffer[1024];
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stop_) return;
+    }
+    fds.assign(1, pollfd{listen_fd_, POLLIN, 0});
+    for (const Client& client : clients_) fds.push_back(pollfd{client.fd_, POLLIN, 0});
+    // wakes up now and then to notice stop_
+    if (poll(fds.data(), fds.size(), 100) <= 0) continue;
+
+    if (fds[0].revents & POLLIN) {
+      const int fd = accept(listen_fd_, nullptr, nullptr);
+      if (fd >= 0) clients_.push_back(Client{fd, {}});
+    }
+    // fds[i + 1] belongs to clients_[i] as it was before the accept
+    for (size_t i = fds.size() - 1; i > 0; --i) {
+      if (!fds[i].revents) continue;
+      Client& client = clients_[i - 1];
+      const ssize_t n = recv(client.fd_, buffer, sizeof(buffer), 0);
+      bool close_client = n <= 0;
+      if (n > 0) client.input_.append(buffer, size_t(n));
+      size_t end;
+      while (!close_client && (end = client.input_.find('\n')) != std::string::npos) {
+        std::string line = client.input_.substr(0, end);
+        client.input_.erase(0, end + 1);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        const std::string reply = Execute(line, close_client);
+        close_client |= send(client.fd_, reply.data(), reply.size(), 0) != ssize_t(reply.size());
+      }
+      close_client |= client.input_.size() > kMaxLine;
+      if (close_client) {
+        close(client.fd_);
+        clients_.erase(clients_.begin() + (i - 1));
+      }
+    }
+  }
+#endif
+}
+
+std::string RenderServer::Execute(const std::string& line, bool& close) {
+  std::istringstream args(line);
+  std::string command;
+  args >> command;
+  if (command == "submit") return Submit(args);
+  if (command == "quit") {
+    close = true;
+    return "ok bye\n";
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (command == "status") {
+    int id;
+    if (args >> id) {
+      auto found = jobs_.find(id);
+      if (found == jobs_.end()) return "error no job " + std::to_string(id) + "\n";
+      return Describe(found->second) + "ok\n";
+    }
+    std::string reply;
+    for (const auto& [id, job] : jobs_) reply += Describe(job);
+    return reply + "ok\n";
+  }
+  if (command == "cancel") {
+    int id = 0;
+    args >> id;
+    auto found = jobs_.find(id);
+    if (found == jobs_.end()) return "error no job " + std::to_string(id) + "\n";
+    RenderJob& job = found->second;
+    if (job.state_ == RenderJob::State::Queued) job.state_ = RenderJob::State::Cancelled;
+    else if (job.state_ == RenderJob::State::Running) job.cancel_ = true;
+    else return "error job " + std::to_string(id) + " already " + kStateNames[int(job.state_)] + "\n";
+    return "ok\n";
+  }
+  if (command == "stats") {
+    int count[5] = {};
+    for (const auto& [id, job] : jobs_) ++count[int(job.state_)];
+    char reply[512];
+    std::snprintf(reply, sizeof(reply),
+                  "ok queued=%d running=%d done=%d failed=%d cancelled=%d scenes=%d scene_hits=%d "
+                  "scene_misses=%d build_ms=%.1f samples=%lld render_s=%.2f samples_per_s=%.0f\n",
+                  count[0], count[1], count[2], count[3], count[4], scenes_warm_, scene_hits_, scene_misses_,
+                  build_seconds_ * 1000, samples_, render_seconds_,
+                  render_seconds_ > 0 ? samples_ / render_seconds_ : 0.0f);
+    return reply;
+  }
+  if (command == "shutdown") {
+    stop_ = true;
+    for (auto& [id, job] : jobs_) {
+      if (job.state_ == RenderJob::State::Queued) job.state_ = RenderJob::State::Cancelled;
+      job.cancel_ = true;
+    }
+    return "ok\n";
+  }
+  return "error unknown command " + command + "\n";
+}
+
+std::string RenderServer::Submit(std::istringstream& args) {
+  RenderJob job;
+  std::string arg;
+  while (args >> arg) {
+    const size_t eq = arg.find('=');
+    if (eq == std::string::npos) return "error expected key=value, got " + arg + "\n";
+    const std::string key = arg.substr(0, eq);
+    const std::string value = arg.substr(eq + 1);
+    try {
+      if (key == "seed") job.seed_ = uint32_t(std::stoul(value));
+      else if (key == "mode" && (value == "rt" || value == "pt")) job.monte_carlo_ = value == "pt";
+      else if (key == "width") job.width_ = std::stoi(value);
+      else if (key == "height") job.height_ = std::stoi(value);
+      else if (key == "spp") job.spp_ = std::stoi(value);
+      else if (key == "seconds") job.seconds_ = std::stof(value);
+      else if (key == "priority") job.priority_ = std::stoi(value);
+      else if (key == "output") job.output_ = value;
+      else return "error bad argument " + arg + "\n";
+    }
+    catch (const std::exception&) {
+      return "error bad argument " + arg + "\n";
+    }
+  }
+  if (job.width_ <= 0 || job.height_ <= 0 || job.width_ > 16384 || job.height_ > 16384)
+    return "error bad resolution\n";
+  if (job.spp_ < 0 || job.seconds_ < 0) return "error bad budget\n";
+  if (!HasExtension(job.output_, ".png") && !HasExtension(job.output_, ".pfm") &&
+      !HasExtension(job.output_, ".hdr") && !HasExtension(job.output_, ".exr"))
+    return "error output must end in .png, .pfm, .hdr or .exr\n";
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (stop_) return "error shutting down\n";
+  job.id_ = next_id_++;
+  jobs_[job.id_] = job;
+  Forget();  // cancelled queued jobs finish without running
+  return "ok " + std::to_string(job.id_) + "\n";
+}
+
+std::string RenderServer::Describe(const RenderJob& job) const {
+  float progress = 0;
+  if (job.state_ == RenderJob::State::Done) progress = 1;
+  else {
+    const int spp = job.spp_ == 0 && job.seconds_ == 0 ? 16 : job.spp_;
+    if (spp > 0) progress = std::max(progress, float(job.samples_) / spp);
+    if (job.seconds_ > 0) progress = std::max(progress, job.elapsed_ / job.seconds_);
+    progress = std::min(progress, 1.0f);
+  }
+  char line[256];
+  std::snprintf(line, sizeof(line), "%d %s progress=%.3f spp=%d seconds=%.2f warm=%d priority=%d ", job.id_,
+                kStateNames[int(job.state_)], progress, job.samples_, job.elapsed_, int(job.warm_),
+                job.priority_);
+  std::string result = line + job.output_;
+  if (!job.error_.empty()) result += " error=" + job.error_;
+  return result + "\n";
+}
+};  // namespace VCL
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "renderer/session.h"
+
+namespace VCL {
+class Renderer;
+
+// one queued or finished render
+struct RenderJob {
+  enum class State : unsigned char { Queued = 0, Running, Done, Failed, Cancelled };
+
+  int id_ = 0;
+  int priority_ = 0;  // higher runs first, equal ones in submission order
+  uint32_t seed_ = 1;  // scene layout, see BuildRoom
+  bool monte_carlo_ = false;
+  int width_ = 800;
+  int height_ = 600;
+  int spp_ = 0;          // samples per pixel, 0 for no limit
+  float seconds_ = 0;    // time budget, 0 for no limit
+  std::string output_;   // .png, or a float format picked by the extension
+
+  State state_ = State::Queued;
+  bool cancel_ = false;
+  bool warm_ = false;  // the scene was already compiled
+  int samples_ = 0;    // finished passes over the image
+  float elapsed_ = 0;  // seconds spent rendering
+  std::string error_;
+};
+
+// Long-running render service on a local TCP port (127.0.0.1 only). Clients
+// send one command per line and every reply ends with a line starting with
+// "ok" or "error":
+//
+//   submit seed=<n> mode=rt|pt width=<w> height=<h> spp=<n> seconds=<s>
+//          priority=<p> output=<path>      -> ok <id>
+//   status [<id>]                           -> one line per job, then ok
+//   cancel <id>                             -> ok
+//   stats                                   -> ok <counters>
+//   quit                                    -> closes the connection
+//   shutdown                                -> cancels everything, Run returns
+//
+// Every key of submit is optional except output; spp and seconds both 0
+// means 16 samples per pixel. Jobs run one at a time on the calling thread
+// and use all cores for the pixels. Compiled scenes with their BVHs, and the
+// irradiance cache and path guide learned on them, are kept for the last
+// warm_scenes_ (seed, mode) pairs, so jobs on the same scene skip the setup;
+// seed 0 asks for a new random layout and is never reused. status and stats
+// cover the running and queued jobs and the last 256 finished ones.
+class RenderServer {
+ public:
+  // kernel features, tonemapper and the cache settings come from `renderer`
+  RenderServer(Renderer& renderer, int port, int warm_scenes);
+  ~RenderServer();
+
+  // serves until shutdown or until the window is closed
+  void Run();
+
+ private:
+  struct WarmScene {
+    std::unique_ptr<RenderSession> session_;
+    uint64_t last_use_ = 0;
+  };
+  struct Client {
+    int fd_ = -1;
+    std::string input_;
+  };
+
+  void Listen();
+  std::string Execute(const std::string& line, bool& close);
+  std::string Submit(std::istringstream& args);
+  std::string Describe(const RenderJob& job) const;
+  RenderJob* Next();
+  // drops the oldest finished jobs beyond the ones kept; under mutex_
+  void Forget();
+  WarmScene& Acquire(RenderJob& job);
+  void Render(RenderJob& job);
+
+  Renderer& renderer_;
+  const int port_;
+  const int warm_scenes_;
+
+  // guards everything below that the listener thread touches
+  std::mutex mutex_;
+  std::map<int, RenderJob> jobs_;
+  int next_id_ = 1;
+  bool stop_ = false;
+  int scenes_warm_ = 0;
+  int scene_hits_ = 0;
+  int scene_misses_ = 0;
+  float build_seconds_ = 0;
+  long long samples_ = 0;  // pixel samples of all jobs
+  float render_seconds_ = 0;
+
+  // only touched by the render thread
+  std::map<std::pair<uint32_t, bool>, std::unique_ptr<WarmScene>> scenes_;
+  std::unique_ptr<WarmScene> random_;  // scene of the last seed 0 job
+  uint64_t clock_ = 0;
+
+  int listen_fd_ = -1;
+  std::vector<Client> clients_;  // only touched by thread_
+  std::thread thread_;
+};
+};  // namespace VCL
@@ -0,0 +1,235 @@
+#include "session.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "common/alloccheck.h"
+#include "common/helperfunc.h"
+#include "graphics/room.h"
+
+namespace VCL {
+RenderSession::RenderSession(int width, int height) : cameras_(1), width_(width), height_(height) {
+  RoomView(cameras_[0], (float)width / height);
+}
+
+void RenderSession::SetResolution(int width, int height) {
+  width_ = width;
+  height_ = height;
+  views_.clear();
+  for (Camera& camera : cameras_) {
+    camera.ResetAspect((float)width / height);
+    camera.UpdateData();
+  }
+  spp_ = 0;
+}
+
+void RenderSession::Configure(const IntegratorSettings& settings) {
+  settings_ = settings;
+  const bool monte_carlo = settings.monte_carlo_;
+  const unsigned features = settings.kernel_features_;
+  kernel_ = GlobIllum::SelectKernel(monte_carlo, features);
+  irradiance_cache_.reset();
+  path_guide_.reset();
+  photon_map_.reset();
+  if (!monte_carlo && (features & GlobIllum::IRRADIANCE_CACHE))
+    irradiance_cache_ = std::make_unique<IrradianceCache>(settings.irradiance_cell_);
+  if (monte_carlo && (features & GlobIllum::GUIDING))
+    path_guide_ = std::make_unique<PathGuide>(settings.guide_cell_);
+  if (monte_carlo && (features & GlobIllum::CAUSTICS))
+    photon_map_ = std::make_unique<PhotonMap>(settings.caustic_radius_);
+  scene_.irradiance_ = irradiance_cache_.get();
+  scene_.guide_ = path_guide_.get();
+  scene_.caustics_ = photon_map_.get();
+}
+
+void RenderSession::Clear() {
+  for (View& view : views_) {
+    view.film_->Clear();
+    if (view.reservoirs_) view.reservoirs_->Clear();
+    // made again for the scene as it is now
+    view.touch_.reset();
+    view.tile_passes_.clear();
+  }
+  if (photon_map_) photon_map_->Reset();
+  spp_ = 0;
+}
+
+void RenderSession::TrackEdits(int tile) {
+  edit_tile_ = tile;
+  Clear();
+}
+
+int RenderSession::Update(const SceneEdit& edit) {
+  for (View& view : views_)
+    if (view.reservoirs_) view.reservoirs_->Clear();
+  bool tracked = !views_.empty();
+  for (const View& view : views_) tracked &= bool(view.touch_);
+  if (!tracked || irradiance_cache_ || photon_map_) {
+    if (irradiance_cache_) irradiance_cache_->Clear();
+    Clear();
+    return -1;
+  }
+
+  std::vector<int> objects, materials;
+  std::vector<AABB> bounds;
+  for (const Object* object : edit.objects_) {
+    objects.push_back(object->id_);
+    bounds.push_back(object->Bounds());  // where it is now
+  }
+  for (const Material* material : edit.materials_) materials.push_back(scene_.MaterialId(material));
+
+  int cleared = 0;
+  for (View& view : views_) {
+    TouchMap& touch = *view.touch_;
+    const int tile = touch.TileSize();
+    for (int t = 0; t < touch.Tiles(); ++t) {
+      if (!touch.Touched(t, objects, materials, edit.lights_, bounds)) continue;
+      const int x0 = t % touch.TilesX() * tile;
+      const int y0 = t / touch.TilesX() * tile;
+      view.film_->Clear(x0, y0, std::min(x0 + tile, width_), std::min(y0 + tile, height_));
+      touch.ClearTile(t);
+      view.tile_passes_[t] = 0;
+      ++cleared;
+    }
+  }
+  return cleared;
+}
+
+int RenderSession::Render(int spp, float seconds) {
+  if (!kernel_) return 0;
+  if (spp <= 0 && seconds <= 0) spp = 1;
+  const auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&start] {
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  };
+  // cameras added since the last call get an empty view
+  views_.resize(cameras_.size());
+  const bool reuse = settings_.kernel_features_ & GlobIllum::RESAMPLED_DIRECT;
+  for (View& view : views_) {
+    if (!view.film_) view.film_ = std::make_unique<Film>(width_, height_);
+    if (!reuse) view.reservoirs_.reset();
+    else if (!view.reservoirs_) view.reservoirs_ = std::make_unique<ReservoirBuffer>(width_, height_);
+    if (!edit_tile_) {
+      view.touch_.reset();
+      view.tile_passes_.clear();
+    }
+    else if (!view.touch_) {
+      view.touch_ = std::make_unique<TouchMap>(scene_, width_, height_, edit_tile_);
+      view.tile_passes_.assign(view.touch_->Tiles(), spp_);
+    }
+  }
+  const int size = width_ * height_;
+  const int views = int(cameras_.size());
+  const real dx = real(1) / width_;
+  const real dy = real(1) / height_;
+
+  auto sample = [&](int v, int p) {
+    AllocFree alloc_free;
+    View& view = views_[v];
+    const int x = p % width_;
+    const int y = p / width_;
+    const Ray ray = cameras_[v].GenerateRay(dx * (x + rand01()), dy * (y + rand01()));
+    g_reservoir_pixel = {view.reservoirs_.get(), x, y};
+    if (view.touch_) {
+      const int tile = view.touch_->Tile(x, y);
+      g_touch = {view.touch_.get(), view.touch_->Bits(tile), view.tile_passes_[tile] % TouchMap::kSpacePasses == 0};
+    }
+    view.film_->AddSample(x, y, kernel_(scene_, ray, nullptr));
+    g_reservoir_pixel = ReservoirPixel();  // SetResolution and Render may free the buffer
+    g_touch = TouchTarget();  // the photon pass traces without a pixel
+  };
+
+  // the pixels of each view in a pass: all of them, or with edits tracked
+  // the tiles that are still behind after Update, if there are any
+  std::vector<std::vector<int>> pixels(views), tiles(views);
+  int passes = 0;
+  while ((spp <= 0 || passes < spp) && (seconds <= 0 || elapsed() < seconds)) {
+    bool catch_up = false;
+    for (const View& view : views_)
+      for (int done : view.tile_passes_) catch_up |= done < spp_;
+    for (int v = 0; v < views; ++v) {
+      pixels[v].clear();
+      tiles[v].clear();
+      const TouchMap* touch = views_[v].touch_.get();
+      if (!touch) {
+        for (int p = 0; p < size; ++p) pixels[v].push_back(p);
+        continue;
+      }
+      const int tile = touch->TileSize();
+      for (int t = 0; t < touch->Tiles(); ++t) {
+        if (catch_up && views_[v].tile_passes_[t] >= spp_) continue;
+        tiles[v].push_back(t);
+        const int x0 = t % touch->TilesX() * tile;
+        const int y0 = t / touch->TilesX() * tile;
+        for (int y = y0; y < std::min(y0 + tile, height_); ++y)
+          for (int x = x0; x < std::min(x0 + tile, width_); ++x) pixels[v].push_back(y * width_ + x);
+      }
+    }
+
+    // one photon pass per pass over the images, as in Renderer::MainLoop
+    if (photon_map_) photon_map_->Emit(scene_, settings_.caustic_photons_);
+    int count = 0;
+    for (const std::vector<int>& work : pixels) count += int(work.size());
+    if (irradiance_cache_) irradiance_cache_->Reserve(count);
+    if (path_guide_) path_guide_->Reserve(count);
+    for (int v = 0; v < views; ++v) {
+      const std::vector<int>& work = pixels[v];
+      # pragma omp parallel for schedule(dynamic, 64)
+      for (int i = 0; i < int(work.size()); ++i) sample(v, work[i]);
+      samples_ += work.size();
+    }
+    CheckAllocFree("a render pass");
+    // samples recorded during the pass become visible to the next one
+    if (irradiance_cache_) irradiance_cache_->Commit();
+    if (path_guide_) path_guide_->Commit();
+    for (int v = 0; v < views; ++v) {
+      View& view = views_[v];
+      if (view.reservoirs_) view.reservoirs_->Swap();
+      if (!view.touch_) continue;
+      view.touch_->Commit();
+      for (int t : tiles[v]) ++view.tile_passes_[t];
+    }
+    if (!catch_up) ++spp_;
+    ++passes;
+  }
+  seconds_ += elapsed();
+  return passes;
+}
+
+void RenderSession::ReadPixels(float* rgb, int view) const {
+  if (view >= int(views_.size())) {
+    std::memset(rgb, 0, sizeof(float) * 3 * width_ * height_);  // not rendered yet
+    return;
+  }
+  std::memcpy(rgb, views_[view].film_->color_[0].data(), sizeof(float) * 3 * width_ * height_);
+}
+
+void RenderSession::ReadPixels(unsigned char* dst, int channels, Tonemapper tonemapper, int view) const {
+  if (view >= int(views_.size())) {
+    for (int i = 0; i < width_ * height_; ++i) std::memset(dst + i * channels, 0, 3);
+    return;
+  }
+  Tonemap(views_[view].film_->color_[0].data(), width_ * height_, dst, channels, tonemapper);
+}
+
+RenderStats RenderSession::Stats() const {
+  RenderStats stats;
+  stats.spp_ = spp_;
+  stats.samples_ = samples_;
+  stats.seconds_ = seconds_;
+  stats.samples_per_second_ = seconds_ > 0 ? samples_ / seconds_ : 0;
+  stats.photons_ = photon_map_ ? photon_map_->Size() : 0;
+  return stats;
+}
+
+std::vector<Camera> StereoPair(const Camera& center, float separation) {
+  std::vector<Camera> pair(2, center);
+  for (int eye = 0; eye < 2; ++eye) {
+    const Vec3f offset = center.right_ * (eye ? 0.5f : -0.5f) * separation;
+    pair[eye].LookAt(center.pos_ + offset, center.target_ + offset);
+    pair[eye].UpdateData();
+  }
+  return pair;
+}
+};  // namespace VCL
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "graphics/camera.h"
+#include "graphics/film.h"
+#include "graphics/globillum.h"
+#include "graphics/irradiancecache.h"
+#include "graphics/pathguide.h"
+#include "graphics/photonmap.h"
+#include "graphics/reservoir.h"
+#include "graphics/scene.h"
+#include "graphics/tonemap.h"
+#include "graphics/touchmap.h"
+
+namespace VCL {
+// what RenderSession::Configure sets up, the same knobs as Renderer
+struct IntegratorSettings {
+  bool monte_carlo_ = false;
+  unsigned kernel_features_ = GlobIllum::SHADOW_RAYS | GlobIllum::SPECULAR;  // GlobIllum::KernelFeature
+  int caustic_photons_ = 100000;  // per pass
+  float caustic_radius_ = 0.05f;
+  float irradiance_cell_ = 0.1f;
+  float guide_cell_ = 0.25f;
+};
+
+// what changed in RenderSession::scene_, for Update
+struct SceneEdit {
+  std::vector<const Object*> objects_;      // scene level objects moved, reshaped or appended
+  std::vector<const Material*> materials_;  // materials whose parameters changed
+  std::vector<int> lights_;                 // entries of Scene::lights_ moved or changed
+};
+
+struct RenderStats {
+  int spp_ = 0;              // samples per pixel in the films
+  long long samples_ = 0;    // camera samples of all views since the session was created
+  float seconds_ = 0;        // spent in Render
+  float samples_per_second_ = 0;
+  int photons_ = 0;          // in the caustic photon map
+};
+
+// The renderer without window, platform or logging, for embedding: one
+// scene seen by one or more cameras, with a film per camera.
+//
+//   RenderSession session(640, 480);
+//   BuildRoom(session.scene_, false, 7);  // or fill scene_ by hand
+//   session.scene_.Compile();
+//   session.Configure(settings);
+//   session.Render(16);                   // or Render(0, 2.5f) for 2.5 s
+//   session.ReadPixels(rgb);
+//
+// Several views (a stereo pair, a camera rig) are rendered together, and
+// the work that does not depend on the view is done once for all of them:
+// the photon pass and the commits of the irradiance cache and path guide
+// happen once per pass, and their records from one view serve the others:
+// the cached irradiance and the learned incident light at a point do not
+// depend on where it is seen from. Camera paths are traced for every view;
+// taking the pixel of another view that sees about the same point would
+// blur across its footprint and bias the image.
+//
+// Render can be called again to refine the images. After changing what is
+// seen (cameras, scene) call Clear; after changing the scene also Compile,
+// and Configure again for caches that match it. With TrackEdits, Update
+// instead of Clear keeps the parts of the images an edit cannot change:
+//
+//   session.TrackEdits();
+//   session.Render(64);
+//   lamp->SetTransform(moved);            // and the lamp's point light
+//   session.scene_.Compile();
+//   session.Update({{lamp}, {}, {light}});
+//   session.Render(64);                   // re-renders the cleared tiles first
+//
+// Not thread safe; Render itself runs on all cores.
+class RenderSession {
+ public:
+  Scene scene_;
+  // one film each, all at the session's resolution; a single RoomView at first
+  std::vector<Camera> cameras_;
+
+  RenderSession(int width, int height);
+
+  int Width() const { return width_; }
+  int Height() const { return height_; }
+  // new empty films; the cameras keep their views and take the new aspect
+  void SetResolution(int width, int height);
+
+  // picks the kernel and creates empty caches for it
+  void Configure(const IntegratorSettings& settings);
+  const IntegratorSettings& Settings() const { return settings_; }
+  // empties the films and restarts the photon map's radius; the irradiance
+  // cache and the path guide keep what they learned
+  void Clear();
+
+  // from the next pass on, record per tile of `tile` x `tile` pixels what
+  // the samples touch (see TouchMap), for Update; 0 stops. Clears the
+  // films.
+  void TrackEdits(int tile = 32);
+  // after editing scene_ and compiling it again: clears the tiles of every
+  // view that touched what changed or sent rays to where an edited object is
+  // now. Following passes render only those tiles until they have as many
+  // samples as the rest. Without TrackEdits, or with an irradiance cache or
+  // photon map, whose light every pixel shares, it clears everything and
+  // the irradiance cache too. Returns the tiles cleared, -1 for everything.
+  int Update(const SceneEdit& edit);
+
+  // passes of one sample per pixel of every view until `spp` passes are done
+  // or `seconds` have passed, 0 for no limit; both 0 renders one pass.
+  // After Update, passes cover only the tiles catching up. Returns the
+  // passes.
+  int Render(int spp, float seconds = 0);
+
+  // copy the film of `view` into Width() * Height() pixels, rows bottom-up:
+  // linear RGB floats, or tonemapped bytes with `channels` 3 or 4 (alpha is
+  // left alone)
+  void ReadPixels(float* rgb, int view = 0) const;
+  void ReadPixels(unsigned char* dst, int channels, Tonemapper tonemapper, int view = 0) const;
+
+  RenderStats Stats() const;
+
+ private:
+  // what is kept per camera
+  struct View {
+    std::unique_ptr<Film> film_;
+    std::unique_ptr<ReservoirBuffer> reservoirs_;  // GlobIllum::RESAMPLED_DIRECT
+    std::unique_ptr<TouchMap> touch_;              // TrackEdits
+    std::vector<int> tile_passes_;                 // TrackEdits: passes of each tile
+  };
+
+  int width_, height_;
+  std::vector<View> views_;  // follows cameras_
+  int edit_tile_ = 0;
+  IntegratorSettings settings_;
+  GlobIllum::Kernel kernel_ = nullptr;
+  std::unique_ptr<PhotonMap> photon_map_;
+  std::unique_ptr<IrradianceCache> irradiance_cache_;
+  std::unique_ptr<PathGuide> path_guide_;
+
+  int spp_ = 0;  // full passes
+  long long samples_ = 0;
+  float seconds_ = 0;
+};
+
+// two cameras `separation` apart along the right axis of `center`, looking
+// in parallel: left then right
+std::vector<Camera> StereoPair(const Camera& center, float separation);
+};  // namespace VCL
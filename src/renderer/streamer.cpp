@@ -0,0 +1,190 @@
+#include "streamer.h"
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace VCL {
+FrameStreamer::FrameStreamer(const std::string& target, StreamFormat format,
+                             int width, int height)
+    : target_(target), format_(format), width_(width), height_(height) {
+  front_.resize(size_t(width) * height * 3);
+  back_.resize(size_t(width) * height * 3);
+  if (target_ == "-") {
+    // stdout carries the frames now, keep the log out of the stream
+    spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+  }
+#ifndef _WIN32
+  // a consumer going away must not kill the renderer
+  std::signal(SIGPIPE, SIG_IGN);
+#endif
+  thread_ = std::thread(&FrameStreamer::Run, this);
+}
+
+FrameStreamer::~FrameStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+  Disconnect();
+#ifndef _WIN32
+  if (listen_fd_ >= 0) close(listen_fd_);
+#endif
+}
+
+void FrameStreamer::Publish(const Framebuffer& framebuffer) {
+  // only waits for the streamer thread while it swaps buffers
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int r = 0; r < height_; ++r) {
+    // framebuffer rows are bottom-up
+    const unsigned char* src = &framebuffer.color_[size_t(height_ - 1 - r) * width_ * 4];
+    unsigned char* dst = &back_[size_t(r) * width_ * 3];
+    for (int c = 0; c < width_; ++c) {
+      dst[3 * c] = src[4 * c];
+      dst[3 * c + 1] = src[4 * c + 1];
+      dst[3 * c + 2] = src[4 * c + 2];
+    }
+  }
+  pending_ = true;
+  cv_.notify_one();
+}
+
+void FrameStreamer::Run() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return pending_ || stop_; });
+      if (stop_) return;
+      front_.swap(back_);
+      pending_ = false;
+    }
+    if (!Connect()) continue;  // nobody listening, drop the frame
+    Encode(front_);
+    if (!Write(encoded_.data(), encoded_.size())) Disconnect();
+  }
+}
+
+bool FrameStreamer::Connect() {
+  if (file_ || client_fd_ >= 0) return true;
+  header_sent_ = false;
+  if (target_ == "-") {
+    file_ = stdout;
+    return true;
+  }
+  if (target_.rfind("tcp:", 0) == 0) {
+#ifndef _WIN32
+    if (listen_fd_ < 0) {
+      listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+      int on = 1;
+      setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = htons((unsigned short)std::stoi(target_.substr(4)));
+      if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+          listen(listen_fd_, 1) != 0) {
+        spdlog::error("stream: cannot listen on {}", target_);
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+      }
+      fcntl(listen_fd_, F_SETFL, fcntl(listen_fd_, F_GETFL) | O_NONBLOCK);
+      spdlog::info("stream: listening on 127.0.0.1:{}", target_.substr(4));
+    }
+    client_fd_ = accept(listen_fd_, nullptr, nullptr);
+    if (client_fd_ >= 0) spdlog::info("stream: client connected");
+    return client_fd_ >= 0;
+#else
+    spdlog::error("stream: tcp output is not supported on this platform");
+    return false;
+#endif
+  }
+#ifndef _WIN32
+  // regular file or named pipe; a pipe without reader is retried next frame
+  const int fd = open(target_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0644);
+  if (fd < 0) return false;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  file_ = fdopen(fd, "wb");
+#else
+  file_ = std::fopen(target_.c_str(), "wb");
+#endif
+  if (!file_) spdlog::error("stream: cannot open {}", target_);
+  return file_ != nullptr;
+}
+
+void FrameStreamer::Disconnect() {
+  if (file_ && file_ != stdout) std::fclose(file_);
+  file_ = nullptr;
+#ifndef _WIN32
+  if (client_fd_ >= 0) {
+    close(client_fd_);
+    spdlog::info("stream: client disconnected");
+  }
+#endif
+  client_fd_ = -1;
+}
+
+void FrameStreamer::Encode(const std::vector<unsigned char>& rgb) {
+  encoded_.clear();
+  auto append = [this](const std::string& s) { encoded_.insert(encoded_.end(), s.begin(), s.end()); };
+  const size_t size = size_t(width_) * height_;
+  switch (format_) {
+    case StreamFormat::RawRGB:
+      encoded_.insert(encoded_.end(), rgb.begin(), rgb.end());
+      break;
+    case StreamFormat::PPM:
+      append("P6\n" + std::to_string(width_) + " " + std::to_string(height_) + "\n255\n");
+      encoded_.insert(encoded_.end(), rgb.begin(), rgb.end());
+      break;
+    case StreamFormat::Y4M: {
+      if (!header_sent_)
+        append("YUV4MPEG2 W" + std::to_string(width_) + " H" + std::to_string(height_) +
+               " F30:1 Ip A1:1 C444 XCOLORRANGE=FULL\n");
+      append("FRAME\n");
+      // full-range BT.601, planar 4:4:4
+      const size_t base = encoded_.size();
+      encoded_.resize(base + 3 * size);
+      unsigned char* y = &encoded_[base];
+      unsigned char* u = y + size;
+      unsigned char* v = u + size;
+      for (size_t i = 0; i < size; ++i) {
+        const float r = rgb[3 * i], g = rgb[3 * i + 1], b = rgb[3 * i + 2];
+        y[i] = (unsigned char)std::clamp(0.299f * r + 0.587f * g + 0.114f * b + 0.5f, 0.0f, 255.0f);
+        u[i] = (unsigned char)std::clamp(-0.168736f * r - 0.331264f * g + 0.5f * b + 128.5f, 0.0f, 255.0f);
+        v[i] = (unsigned char)std::clamp(0.5f * r - 0.418688f * g - 0.081312f * b + 128.5f, 0.0f, 255.0f);
+      }
+      break;
+    }
+  }
+  header_sent_ = true;
+}
+
+bool FrameStreamer::Write(const void* data, size_t size) {
+  if (file_) return std::fwrite(data, 1, size, file_) == size && std::fflush(file_) == 0;
+#ifndef _WIN32
+  const char* p = (const char*)data;
+  while (size > 0) {
+    const ssize_t n = send(client_fd_, p, size, 0);
+    if (n <= 0) return false;
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+};  // namespace VCL
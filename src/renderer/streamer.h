@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "graphics/framebuffer.h"
+
+namespace VCL {
+enum class StreamFormat : unsigned char { RawRGB = 0, Y4M, PPM };
+
+// Publishes resolved frames to stdout ("-"), a file or named pipe, or a local
+// TCP port ("tcp:<port>", clients connect to 127.0.0.1). Publish only copies the
+// frame into a back buffer; encoding and I/O happen on the streamer's own
+// thread, and frames are dropped while it is still busy with an older one.
+class FrameStreamer {
+ public:
+  FrameStreamer(const std::string& target, StreamFormat format, int width,
+                int height);
+  ~FrameStreamer();
+
+  void Publish(const Framebuffer& framebuffer);
+
+ private:
+  void Run();
+  bool Connect();
+  void Disconnect();
+  void Encode(const std::vector<unsigned char>& rgb);
+  bool Write(const void* data, size_t size);
+
+  const std::string target_;
+  const StreamFormat format_;
+  const int width_;
+  const int height_;
+
+  // double-buffered snapshot, back_ is filled by Publish
+  std::vector<unsigned char> front_;
+  std::vector<unsigned char> back_;
+  bool pending_ = false;
+  bool stop_ = false;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread thread_;
+
+  // output state, only touched by thread_
+  FILE* file_ = nullptr;
+  int listen_fd_ = -1;
+  int client_fd_ = -1;
+  bool header_sent_ = false;
+  std::vector<unsigned char> encoded_;
+};
+};  // namespace VCL
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdio>
+
+// Tests are plain programs: CHECK reports a failed condition and marks the
+// run failed, main returns Failures() so the exit status tells the result.
+namespace Test {
+
+inline int &Failures()
+{
+  static int failures = 0;
+  return failures;
+}
+
+}
+
+#define CHECK(cond)                                                          \
+  do {                                                                       \
+    if (!(cond)) {                                                           \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      Test::Failures()++;                                                    \
+    }                                                                        \
+  } while (0)
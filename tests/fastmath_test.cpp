@@ -0,0 +1,95 @@
+#include "check.h"
+
+#include "common/fastmath.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+using namespace VCL;
+
+// Sweeps the FAST_MATH approximations against double precision libm over
+// the ranges documented in fastmath.h and checks the error bounds stated
+// there. `worst` is the largest error seen as a fraction of its bound, so
+// it has to stay at or below 1.
+
+namespace {
+
+float FromBits(uint32_t bits)
+{
+  float x;
+  std::memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// every `stride`-th normal positive float
+void SweepNormals(uint32_t stride, const std::function<void(float)> &f)
+{
+  for (uint32_t bits = 0x00800000u; bits < 0x7F800000u; bits += stride) f(FromBits(bits));
+}
+
+// `n` + 1 evenly spaced values from `lo` to `hi`
+void SweepRange(double lo, double hi, int n, const std::function<void(float)> &f)
+{
+  for (int i = 0; i <= n; i++) f(float(lo + (hi - lo) * i / n));
+}
+
+double Report(const char *name, double worst)
+{
+  std::printf("%-10s worst error %.3f of its bound\n", name, worst);
+  return worst;
+}
+
+}
+
+int main()
+{
+  double worst = 0;
+  SweepRange(-126, 126, 4000000, [&](float x) {
+    const double exact = std::exp2(double(x));
+    worst = std::max(worst, std::abs(FastExp2(x) - exact) / exact / 1.1e-7);
+  });
+  CHECK(Report("FastExp2", worst) <= 1);
+
+  worst = 0;
+  SweepNormals(331, [&](float x) {
+    const double exact = std::log2(double(x));
+    worst = std::max(worst, std::abs(FastLog2(x) - exact) / (1.2e-7 + 6e-8 * std::abs(exact)));
+  });
+  CHECK(Report("FastLog2", worst) <= 1);
+
+  worst = 0;
+  SweepRange(-20, 20, 2000, [&](float lx) {
+    const float x = std::exp2(lx);
+    SweepRange(-100, 100, 2000, [&](float y) {
+      const double l = double(y) * std::log2(double(x));
+      if (std::abs(l) >= 126) return;
+      const double exact = std::pow(double(x), double(y));
+      const double bound = 4.7e-7 + 1e-7 * std::abs(y) + 6e-8 * std::abs(l);
+      worst = std::max(worst, std::abs(FastPow(x, y) - exact) / exact / bound);
+    });
+  });
+  CHECK(Report("FastPow", worst) <= 1);
+  // outside the domain it is libm
+  CHECK(FastPow(0, 2) == 0);
+  CHECK(FastPow(-2, 2) == std::pow(-2.0f, 2.0f));
+
+  worst = 0;
+  SweepRange(-1e4, 1e4, 8000000, [&](float x) {
+    float s, c;
+    FastSinCos(x, s, c);
+    const double err = std::max(std::abs(s - std::sin(double(x))), std::abs(c - std::cos(double(x))));
+    worst = std::max(worst, err / 9.4e-8);
+  });
+  CHECK(Report("FastSinCos", worst) <= 1);
+
+  worst = 0;
+  SweepNormals(331, [&](float x) {
+    const double exact = 1 / std::sqrt(double(x));
+    worst = std::max(worst, std::abs(FastRsqrt(x) - exact) / exact / 2.6e-7);
+  });
+  CHECK(Report("FastRsqrt", worst) <= 1);
+
+  return Test::Failures();
+}
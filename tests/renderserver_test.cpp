@@ -0,0 +1,168 @@
+#include "check.h"
+
+#include "renderer/renderer.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+using namespace VCL;
+
+// Runs the job server of a headless Renderer on 127.0.0.1 and drives it the
+// way a client does: submits jobs over TCP, polls their status and checks
+// the replies, the written image and the warm scene reuse.
+
+namespace {
+
+// a port nobody listens on right now
+int FreePort()
+{
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t size = sizeof(addr);
+  bind(fd, (sockaddr *)&addr, sizeof(addr));
+  getsockname(fd, (sockaddr *)&addr, &size);
+  close(fd);
+  return ntohs(addr.sin_port);
+}
+
+class Client
+{
+public:
+
+  bool Connect(int port)
+  {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    // the server starts listening on the other thread
+    for (int attempt = 0; attempt < 100; attempt++) {
+      fd_ = socket(AF_INET, SOCK_STREAM, 0);
+      if (connect(fd_, (sockaddr *)&addr, sizeof(addr)) == 0) return true;
+      close(fd_);
+      fd_ = -1;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+  }
+
+  ~Client()
+  {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  // sends one command, returns the reply up to and including its ok or error line
+  std::string Send(const std::string &command)
+  {
+    const std::string line = command + "\n";
+    if (send(fd_, line.data(), line.size(), 0) != ssize_t(line.size())) return "";
+    std::string reply;
+    char buffer[1024];
+    for (;;) {
+      size_t end;
+      while ((end = input_.find('\n')) != std::string::npos) {
+        reply += input_.substr(0, end + 1);
+        const std::string last = input_.substr(0, end);
+        input_.erase(0, end + 1);
+        if (last.compare(0, 2, "ok") == 0 || last.compare(0, 5, "error") == 0) return reply;
+      }
+      const ssize_t n = recv(fd_, buffer, sizeof(buffer), 0);
+      if (n <= 0) return reply;
+      input_.append(buffer, size_t(n));
+    }
+  }
+
+  // polls until job `id` has finished, returns its status line
+  std::string Wait(int id)
+  {
+    for (int attempt = 0; attempt < 600; attempt++) {
+      const std::string status = Send("status " + std::to_string(id));
+      if (status.find(" queued ") == std::string::npos && status.find(" running ") == std::string::npos)
+        return status;
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return "";
+  }
+
+private:
+
+  int fd_ = -1;
+  std::string input_;
+};
+
+int JobId(const std::string &reply)
+{
+  int id = 0;
+  return std::sscanf(reply.c_str(), "ok %d", &id) == 1 ? id : 0;
+}
+
+bool Contains(const std::string &text, const char *part) { return text.find(part) != std::string::npos; }
+
+}
+
+int main()
+{
+  const int port = FreePort();
+  const std::string output = "renderserver_test.pfm";
+  std::remove(output.c_str());
+
+  Renderer renderer;
+  renderer.server_port_ = port;
+  renderer.warm_scenes_ = 2;
+  renderer.Init("renderserver_test", 64, 48, false, false, false);
+
+  std::thread client_thread([&]() {
+    Client client;
+    CHECK(client.Connect(port));
+
+    const std::string submit = "submit seed=3 width=32 height=24 spp=2 output=" + output;
+    const int first = JobId(client.Send(submit));
+    CHECK(first > 0);
+    const std::string done = client.Wait(first);
+    CHECK(Contains(done, " done "));
+    CHECK(Contains(done, "warm=0"));
+    std::FILE *image = std::fopen(output.c_str(), "rb");
+    CHECK(image != nullptr);
+    if (image) std::fclose(image);
+
+    // the same seed again reuses the compiled scene
+    const int second = JobId(client.Send(submit));
+    CHECK(Contains(client.Wait(second), "warm=1"));
+
+    // seed 0 is a new random room every time
+    const std::string random = "submit seed=0 width=32 height=24 spp=1 output=" + output;
+    CHECK(Contains(client.Wait(JobId(client.Send(random))), "warm=0"));
+    CHECK(Contains(client.Wait(JobId(client.Send(random))), "warm=0"));
+
+    // finished jobs are forgotten beyond the last 256
+    const std::string tiny = "submit seed=3 width=1 height=1 spp=1 output=" + output;
+    int last = 0;
+    for (int i = 0; i < 300; i++) last = JobId(client.Send(tiny));
+    CHECK(Contains(client.Wait(last), " done "));
+    CHECK(Contains(client.Send("status " + std::to_string(first)), "error no job"));
+    const std::string all = client.Send("status");
+    CHECK(std::count(all.begin(), all.end(), '\n') == 256 + 1);
+
+    CHECK(Contains(client.Send("submit seed=1 output=a.txt"), "error"));
+    CHECK(Contains(client.Send("status 9999"), "error no job"));
+    CHECK(Contains(client.Send("stats"), "ok queued=0 running=0 done=256"));
+    CHECK(Contains(client.Send("shutdown"), "ok"));
+  });
+
+  renderer.MainLoop();  // serves until the shutdown above
+  client_thread.join();
+  renderer.Destroy();
+  std::remove(output.c_str());
+  std::printf("renderserver: %d failures\n", Test::Failures());
+  return Test::Failures();
+}
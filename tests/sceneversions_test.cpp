@@ -0,0 +1,82 @@
+#include "check.h"
+
+#include "graphics/camera.h"
+#include "graphics/room.h"
+#include "graphics/sceneversions.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace VCL;
+
+// Readers pin, trace and unpin while editors publish new versions, the
+// hazard pointer protocol of SceneVersions under load. Build it with
+// -fsanitize=address or -fsanitize=thread as well: a version deleted while
+// pinned shows up there, not in the checks.
+//
+// Every edit adds 1 to the red ambient light, so a version carries its own
+// number and a reader can tell a torn or stale scene from the right one.
+int main()
+{
+  constexpr int kEdits = 2000;
+  constexpr int kEditors = 2;
+
+  Scene first;
+  BuildRoom(first, false, 7);
+  first.ambient_light_[0] = 0;
+  first.Compile();
+  Camera camera;
+  RoomView(camera, 1);
+  SceneVersions versions(first);
+
+  std::atomic<bool> done(false);
+  std::atomic<int> bad_versions(0), bad_hits(0), pins(0);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < SceneVersions::kReaders; r++) {
+    readers.emplace_back([&, r]() {
+      uint64_t last = 0;
+      for (int i = 0; !done.load() || i < 100; i++) {
+        uint64_t version = 0;
+        const Scene &scene = versions.Pin(version, r);
+        if (version < last || scene.ambient_light_[0] != real(version)) bad_versions++;
+        last = version;
+        // touches the objects and BVH nodes of the pinned version
+        Vec3 pos;
+        if (!scene.Intersect(camera.GenerateRay(real(0.5), real(0.5)), pos)) bad_hits++;
+        versions.Unpin(r);
+        pins++;
+      }
+    });
+  }
+
+  std::vector<std::thread> editors;
+  std::atomic<uint64_t> max_version(0);
+  for (int e = 0; e < kEditors; e++) {
+    editors.emplace_back([&, e]() {
+      for (int i = 0; i < kEdits; i++) {
+        const uint64_t number = versions.Edit([&](Scene &scene) {
+          scene.ambient_light_[0] += 1;
+          scene.Animate(real(0.01) * (i + e));
+        });
+        uint64_t seen = max_version.load();
+        while (seen < number && !max_version.compare_exchange_weak(seen, number)) { }
+      }
+    });
+  }
+  for (auto &editor : editors) editor.join();
+  done = true;
+  for (auto &reader : readers) reader.join();
+
+  CHECK(bad_versions == 0);
+  CHECK(bad_hits == 0);
+  CHECK(max_version == uint64_t(kEdits) * kEditors);
+  CHECK(pins >= 100 * SceneVersions::kReaders);
+  uint64_t version = 0;
+  const Scene &last = versions.Pin(version);
+  CHECK(version == uint64_t(kEdits) * kEditors);
+  CHECK(last.ambient_light_[0] == real(version));
+  versions.Unpin();
+  std::printf("sceneversions: %d pins, %d failures\n", pins.load(), Test::Failures());
+  return Test::Failures();
+}
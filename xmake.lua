@@ -5,10 +5,23 @@ add_requires("eigen", "spdlog", "stb", "openmp")
 add_rules("mode.release", "mode.debug")
 set_languages("cxx17")
 
+-- the renderer without window or platform code, for embedding through
+-- RenderSession (src/renderer/session.h); static by default, `xmake f -k shared`
+-- builds a shared library
+target("SoftRenderCore")
+    set_kind("$(kind)")
+    add_includedirs("src", {public=true})
+    add_files("src/common/*.cpp", "src/graphics/*.cpp", "src/renderer/session.cpp")
+    add_packages("eigen", "stb", "openmp", {public=true})
+    set_targetdir("bin")
+
+-- the windowed app, job server and poster renderer on top of it; in debug
+-- builds it also replaces operator new for the AllocFree checks
+-- (src/renderer/allocnew.cpp), which the library leaves to its host
 target("SoftRender")
     set_kind("binary")
-    add_includedirs("src")
-    add_files("src/main.cpp", "src/common/*.cpp", "src/graphics/*.cpp", "src/renderer/*.cpp")
+    add_deps("SoftRenderCore")
+    add_files("src/main.cpp", "src/renderer/*.cpp|session.cpp")
     if is_plat("windows", "mingw") then
         add_files("src/platforms/win32.cpp")
         add_syslinks("Gdi32", "User32")
@@ -16,6 +29,35 @@ target("SoftRender")
         add_frameworks("Cocoa")
         add_files("src/platforms/macos.mm")
         set_values("objc++.build.arc", false)
+    else
+        add_files("src/platforms/headless.cpp")
+        add_syslinks("pthread")
     end
     add_packages("eigen", "spdlog", "stb", "openmp", {public=true})
     set_targetdir("bin")
+
+-- tests, plain programs that exit non-zero on failure: `xmake build -g test`,
+-- then `xmake run <name>`. sceneversions_test is meant to be run with
+-- -fsanitize=thread and -fsanitize=address as well (through --cxflags and
+-- --ldflags of `xmake f`). renderserver_test drives the job server of a
+-- headless Renderer over 127.0.0.1, which needs the app sources and POSIX
+-- sockets
+for _, file in ipairs(os.files("tests/*_test.cpp")) do
+    local name = path.basename(file)
+    if name ~= "renderserver_test" or not is_plat("windows", "mingw") then
+        target(name)
+            set_kind("binary")
+            set_default(false)
+            set_group("test")
+            add_deps("SoftRenderCore")
+            add_files(file)
+            if name == "renderserver_test" then
+                add_files("src/renderer/*.cpp|session.cpp", "src/platforms/headless.cpp")
+                add_packages("spdlog")
+            end
+            if not is_plat("windows", "mingw") then
+                add_syslinks("pthread")
+            end
+            set_targetdir("bin")
+    end
+end